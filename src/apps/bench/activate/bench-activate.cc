@@ -19,15 +19,41 @@
 #include <m3/cap/MemGate.h>
 #include <m3/util/Profile.h>
 #include <m3/Syscalls.h>
+#include <m3/EPMux.h>
 #include <m3/DTU.h>
 #include <m3/Log.h>
 
 using namespace m3;
 
 #define COUNT   100
+#define ROUNDS  50
+#define GATES   EP_COUNT
 
 static word_t buffer[4];
 
+// a copy-like pattern: read from <src>, write to <dst> and access one of the other gates in between
+static void alternate(MemGate **gates) {
+    size_t before = EPMux::get().activations();
+    for(int i = 0; i < ROUNDS; ++i) {
+        gates[0]->read_sync(buffer, sizeof(buffer), 0);
+        gates[1]->write_sync(buffer, sizeof(buffer), 0);
+        gates[2 + i % (GATES - 2)]->read_sync(buffer, sizeof(buffer), 0);
+    }
+    Serial::get() << "Alternate: " << (EPMux::get().activations() - before) << " activations\n";
+}
+
+// like above, but access all other gates in between
+static void sweep(const char *name, MemGate **gates) {
+    size_t before = EPMux::get().activations();
+    for(int i = 0; i < ROUNDS; ++i) {
+        gates[0]->read_sync(buffer, sizeof(buffer), 0);
+        gates[1]->write_sync(buffer, sizeof(buffer), 0);
+        for(size_t j = 2; j < GATES; ++j)
+            gates[j]->read_sync(buffer, sizeof(buffer), 0);
+    }
+    Serial::get() << name << ": " << (EPMux::get().activations() - before) << " activations\n";
+}
+
 int main() {
     MemGate mem = MemGate::create_global(0x1000, MemGate::RW);
     mem.read_sync(buffer, sizeof(buffer), 0);
@@ -39,5 +65,19 @@ int main() {
         total += end - start;
     }
     Serial::get() << "Per activate: " << (total / COUNT) << "\n";
+
+    // use more gates than endpoints to see how often the EPMux has to switch them
+    MemGate *gates[GATES];
+    for(size_t i = 0; i < GATES; ++i)
+        gates[i] = new MemGate(MemGate::create_global(0x1000, MemGate::RW));
+
+    alternate(gates);
+    sweep("Sweep", gates);
+    if(gates[0]->pin() != Errors::NO_ERROR || gates[1]->pin() != Errors::NO_ERROR)
+        PANIC("Unable to pin gates: " << Errors::to_string(Errors::last));
+    sweep("Sweep (pinned)", gates);
+
+    for(size_t i = 0; i < GATES; ++i)
+        delete gates[i];
     return 0;
 }
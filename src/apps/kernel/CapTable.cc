@@ -19,12 +19,99 @@
 
 namespace m3 {
 
+static_assert(EP_COUNT < sizeof(word_t) * 8, "Too many endpoints for the invalidation mask");
+
 CapTable CapTable::_kcaps(0);
+word_t CapTable::_inveps[AVAIL_PES];
 
 void CapTable::revoke_all() {
-    for(capsel_t i = 0; i < MAX_ENTRIES; ++i) {
-        if(_caps[i])
-            revoke(CapRngDesc(i));
+    // revoke might fail, so that we have to move on in any case
+    for(capsel_t i = next_used(0); i != NONE; i = next_used(i + 1))
+        revoke_tree(get(i), nullptr);
+    // our own VPE is about to be destroyed; its endpoints have been invalidated on exit
+    if(_id > 0)
+        _inveps[_id - 1] = 0;
+    invalidate_eps();
+}
+
+capsel_t CapTable::next_used(capsel_t start) const {
+    if(!valid(start))
+        return NONE;
+
+    size_t leaf = start / LEAF_BITS;
+    word_t mask = ~static_cast<word_t>(0) << (start % LEAF_BITS);
+    while(leaf < LEAF_COUNT) {
+        // skip all leafs that are not allocated
+        word_t leafs = _leafmap[leaf / LEAF_BITS] & (~static_cast<word_t>(0) << (leaf % LEAF_BITS));
+        if(leafs == 0) {
+            leaf = Math::round_up(leaf + 1, LEAF_BITS);
+            mask = ~static_cast<word_t>(0);
+            continue;
+        }
+        size_t next = Math::round_dn(leaf, LEAF_BITS) + __builtin_ctzl(leafs);
+        if(next != leaf)
+            mask = ~static_cast<word_t>(0);
+        leaf = next;
+
+        word_t used = _leafs[leaf]->used & mask;
+        if(used)
+            return leaf * LEAF_BITS + __builtin_ctzl(used);
+        leaf++;
+        mask = ~static_cast<word_t>(0);
+    }
+    return NONE;
+}
+
+size_t CapTable::count_used(const m3::CapRngDesc &crd) const {
+    size_t count = 0;
+    capsel_t end = crd.start() + crd.count();
+    for(capsel_t i = crd.start(); i < end; ) {
+        size_t off = i % LEAF_BITS;
+        size_t bits = Math::min<size_t>(LEAF_BITS - off, end - i);
+        const Leaf *l = _leafs[i / LEAF_BITS];
+        if(l) {
+            word_t mask = bits == LEAF_BITS ? ~static_cast<word_t>(0)
+                                            : ((static_cast<word_t>(1) << bits) - 1) << off;
+            count += __builtin_popcountl(l->used & mask);
+        }
+        i += bits;
+    }
+    return count;
+}
+
+void CapTable::set(capsel_t i, Capability *c) {
+    assert(get(i) == nullptr);
+    if(c == nullptr) {
+        LOG(CAPS, "CapTable[" << _id << "]: Setting " << i << " to NULL");
+        return;
+    }
+
+    c->put(this, i);
+    LOG(CAPS, "CapTable[" << _id << "]: Setting " << i << " to " << *c);
+
+    size_t leaf = i / LEAF_BITS;
+    if(_leafs[leaf] == nullptr) {
+        _leafs[leaf] = new Leaf();
+        _leafmap[leaf / LEAF_BITS] |= static_cast<word_t>(1) << (leaf % LEAF_BITS);
+    }
+    _leafs[leaf]->caps[i % LEAF_BITS] = c;
+    _leafs[leaf]->used |= static_cast<word_t>(1) << (i % LEAF_BITS);
+}
+
+void CapTable::unset(capsel_t i) {
+    LOG(CAPS, "CapTable[" << _id << "]: Unsetting " << i);
+    size_t leaf = i / LEAF_BITS;
+    Leaf *l = _leafs[leaf];
+    if(l == nullptr)
+        return;
+
+    delete l->caps[i % LEAF_BITS];
+    l->caps[i % LEAF_BITS] = nullptr;
+    l->used &= ~(static_cast<word_t>(1) << (i % LEAF_BITS));
+    if(l->used == 0) {
+        delete l;
+        _leafs[leaf] = nullptr;
+        _leafmap[leaf / LEAF_BITS] &= ~(static_cast<word_t>(1) << (leaf % LEAF_BITS));
     }
 }
 
@@ -49,45 +136,78 @@ void CapTable::inherit(Capability *parent, Capability *child) {
     parent->_child = child;
 }
 
-Errors::Code CapTable::revoke_rec(Capability *c, bool revnext) {
-    Capability *child = c->child();
-    Capability *next = c->next();
-
-    Errors::Code res = c->revoke();
-    // actually, this is a bit specific for service+session. although it failed to revoke the service
-    // we want to revoke all childs, i.e. the sessions to remove them from the service.
-    // TODO if there are other failable revokes, we need to reconsider that
-    if(res == Errors::NO_ERROR)
-        c->table()->unset(c->sel());
-    // reset the child-pointer since we're revoking all childs
-    // note that we would need to do much more if delegatable capabilities could deny a revoke
-    else
-        c->_child = nullptr;
-
-    if(child)
-        revoke_rec(child, true);
-    // on the first level, we don't want to revoke siblings
-    if(revnext && next)
-        revoke_rec(next, true);
-    return res;
+Errors::Code CapTable::revoke_tree(Capability *c, size_t *count) {
+    if(c->_next)
+        c->_next->_prev = c->_prev;
+    if(c->_prev)
+        c->_prev->_next = c->_next;
+    if(c->_parent && c->_parent->_child == c)
+        c->_parent->_child = c->_next;
+
+    // we walk through the tree with a stack of sibling-lists instead of recursing. the parent of
+    // each list-head is not needed anymore (it is revoked), so that we use it to link the stack
+    c->_next = nullptr;
+    c->_parent = nullptr;
+    Capability *stack = c;
+    Errors::Code rootres = Errors::NO_ERROR;
+    while(stack) {
+        Capability *cur = stack;
+        stack = stack->_parent;
+
+        while(cur) {
+            Capability *child = cur->child();
+            Capability *next = cur->next();
+
+            Errors::Code res = cur->revoke();
+            if(cur == c)
+                rootres = res;
+            // actually, this is a bit specific for service+session. although it failed to revoke
+            // the service we want to revoke all childs, i.e. the sessions to remove them from the
+            // service.
+            // TODO if there are other failable revokes, we need to reconsider that
+            if(res == Errors::NO_ERROR) {
+                cur->table()->unset(cur->sel());
+                if(count)
+                    (*count)++;
+            }
+            // reset the child-pointer since we're revoking all childs
+            // note that we would need to do much more if delegatable capabilities could deny a revoke
+            else
+                cur->_child = nullptr;
+
+            if(child) {
+                child->_parent = stack;
+                stack = child;
+            }
+            cur = next;
+        }
+    }
+    return rootres;
+}
+
+void CapTable::invalidate_eps() {
+    for(int i = 0; i < AVAIL_PES; ++i) {
+        if(_inveps[i]) {
+            // the VPE might be already gone, in which case there is nothing to invalidate
+            if(PEManager::get().exists(i))
+                PEManager::get().vpe(i).invalidate_eps(_inveps[i]);
+            _inveps[i] = 0;
+        }
+    }
 }
 
-Errors::Code CapTable::revoke(const m3::CapRngDesc &crd) {
+Errors::Code CapTable::revoke(const m3::CapRngDesc &crd, size_t *count) {
+    Errors::Code res = Errors::NO_ERROR;
     for(capsel_t i = 0; i < crd.count(); ++i) {
         Capability *c = get(i + crd.start());
         if(c) {
-            if(c->_next)
-                c->_next->_prev = c->_prev;
-            if(c->_prev)
-                c->_prev->_next = c->_next;
-            if(c->_parent && c->_parent->_child == c)
-                c->_parent->_child = c->_next;
-            Errors::Code res = revoke_rec(c, false);
+            res = revoke_tree(c, count);
             if(res != Errors::NO_ERROR)
-                return res;
+                break;
         }
     }
-    return Errors::NO_ERROR;
+    invalidate_eps();
+    return res;
 }
 
 void CapTable::print_rec(OStream &os, int level, const Capability *c) {
@@ -100,14 +220,12 @@ void CapTable::print_rec(OStream &os, int level, const Capability *c) {
 
 OStream &operator<<(OStream &os, const CapTable &ct) {
     os << "CapTable[" << ct.id() << "]:\n";
-    for(size_t i = 0; i < CapTable::MAX_ENTRIES; ++i) {
-        if(ct._caps[i]) {
-            os << "  " << *ct._caps[i] << "\n";
-            if(ct._caps[i]->child())
-                CapTable::print_rec(os, 2, ct._caps[i]->child());
-        }
+    for(capsel_t i = ct.next_used(0); i != CapTable::NONE; i = ct.next_used(i + 1)) {
+        const Capability *c = ct.get(i);
+        os << "  " << *c << "\n";
+        if(c->child())
+            CapTable::print_rec(os, 2, c->child());
     }
     return os;
 }
-
 }
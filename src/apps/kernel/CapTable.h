@@ -23,6 +23,7 @@
 
 #include "Services.h"
 #include "Capability.h"
+#include "SlabCache.h"
 
 namespace m3 {
 
@@ -34,18 +35,35 @@ class CapTable {
     friend OStream &operator<<(OStream &os, const CapTable &ct);
 
     static constexpr size_t MAX_ENTRIES    = VPE::SEL_TOTAL;
+    // the table is a two-level radix tree. the leafs are allocated on demand and freed if they
+    // become empty, so that the memory usage depends on the used capabilities
+    static constexpr size_t LEAF_BITS      = sizeof(word_t) * 8;
+    static constexpr size_t LEAF_COUNT     = (MAX_ENTRIES + LEAF_BITS - 1) / LEAF_BITS;
+    static constexpr size_t MAP_WORDS      = (LEAF_COUNT + LEAF_BITS - 1) / LEAF_BITS;
+
+    struct Leaf {
+        SLAB_ALLOCATED(Leaf)
+
+        explicit Leaf() : used(), caps() {
+        }
+
+        // a bit for every used entry in <caps>
+        word_t used;
+        Capability *caps[LEAF_BITS];
+    };
+
 public:
+    static constexpr capsel_t NONE          = static_cast<capsel_t>(-1);
+
     static CapTable &kernel_table() {
         return _kcaps;
     }
 
-    explicit CapTable(uint id) : _id(id), _caps() {
+    explicit CapTable(uint id) : _id(id), _leafmap(), _leafs() {
     }
-    CapTable(const CapTable &ct, uint id) : _id(id), _caps() {
-        for(size_t i = 0; i < MAX_ENTRIES; ++i) {
-            if(ct._caps[i])
-                _caps[i] = ct._caps[i]->clone();
-        }
+    CapTable(const CapTable &ct, uint id) : _id(id), _leafmap(), _leafs() {
+        for(capsel_t i = ct.next_used(0); i != NONE; i = ct.next_used(i + 1))
+            set(i, const_cast<Capability*>(ct.get(i))->clone());
     }
     ~CapTable() {
         revoke_all();
@@ -58,74 +76,82 @@ public:
         return i < MAX_ENTRIES;
     }
     bool unused(capsel_t i) const {
-        return valid(i) && _caps[i] == nullptr;
+        return valid(i) && get(i) == nullptr;
     }
     bool used(capsel_t i) const {
-        return valid(i) && _caps[i] != nullptr;
+        return valid(i) && get(i) != nullptr;
     }
     bool range_unused(const m3::CapRngDesc &crd) const {
-        if(!range_valid(crd))
-            return false;
-        for(capsel_t i = crd.start(); i < crd.start() + crd.count(); ++i) {
-            if(_caps[i] != nullptr)
-                return false;
-        }
-        return true;
+        return range_valid(crd) && count_used(crd) == 0;
     }
     bool range_used(const m3::CapRngDesc &crd) const {
-        if(!range_valid(crd))
-            return false;
-        for(capsel_t i = crd.start(); i < crd.start() + crd.count(); ++i) {
-            if(_caps[i] == nullptr)
-                return false;
-        }
-        return true;
+        return range_valid(crd) && count_used(crd) == crd.count();
     }
 
+    /**
+     * @param start the selector to start at
+     * @return the first used selector >= <start> or NONE
+     */
+    capsel_t next_used(capsel_t start) const;
+
     Capability *obtain(capsel_t dst, Capability *c);
     void inherit(Capability *parent, Capability *child);
-    Errors::Code revoke(const m3::CapRngDesc &crd);
+    /**
+     * Revokes the capabilities in <crd> and all capabilities derived from them. The endpoints
+     * that refer to revoked capabilities are invalidated afterwards, one write per range of
+     * endpoints of each affected VPE.
+     *
+     * @param crd the capabilities
+     * @param count if not null, the number of removed capabilities is added to it
+     * @return the result of the first capability that could not be revoked
+     */
+    Errors::Code revoke(const m3::CapRngDesc &crd, size_t *count = nullptr);
+
+    /**
+     * Remembers that endpoint <ep> of VPE <vpe> has to be invalidated once the current revoke
+     * is finished.
+     */
+    static void invalidate_later(int vpe, size_t ep) {
+        _inveps[vpe] |= static_cast<word_t>(1) << ep;
+    }
 
     Capability *get(capsel_t i) {
+        return const_cast<Capability*>(const_cast<const CapTable*>(this)->get(i));
+    }
+    const Capability *get(capsel_t i) const {
         if(!valid(i))
             return nullptr;
-        return _caps[i];
+        const Leaf *l = _leafs[i / LEAF_BITS];
+        return l ? l->caps[i % LEAF_BITS] : nullptr;
     }
     Capability *get(capsel_t i, unsigned types) {
-        if(!valid(i) || _caps[i] == nullptr || !(_caps[i]->type & types))
+        Capability *c = get(i);
+        if(c == nullptr || !(c->type & types))
             return nullptr;
-        return _caps[i];
+        return c;
     }
 
-    void set(capsel_t i, Capability *c) {
-        assert(_caps[i] == nullptr);
-        if(c) {
-            c->put(this, i);
-            LOG(CAPS, "CapTable[" << _id << "]: Setting " << i << " to " << *c);
-        }
-        else
-            LOG(CAPS, "CapTable[" << _id << "]: Setting " << i << " to NULL");
-        _caps[i] = c;
-    }
-    void unset(capsel_t i) {
-        LOG(CAPS, "CapTable[" << _id << "]: Unsetting " << i);
-        delete _caps[i];
-        _caps[i] = nullptr;
-    }
+    void set(capsel_t i, Capability *c);
+    void unset(capsel_t i);
 
     void revoke_all();
 
 private:
-    static Errors::Code revoke_rec(Capability *c, bool revnext);
+    static Errors::Code revoke_tree(Capability *c, size_t *count);
+    static void invalidate_eps();
     static void print_rec(OStream &os, int level, const Capability *c);
+    size_t count_used(const m3::CapRngDesc &crd) const;
     bool range_valid(const m3::CapRngDesc &crd) const {
         return crd.count() == 0 || (crd.start() + crd.count() > crd.start() && valid(crd.start())
                 && valid(crd.start() + crd.count() - 1));
     }
 
     uint _id;
-    Capability *_caps[MAX_ENTRIES];
+    // a bit for every allocated leaf
+    word_t _leafmap[MAP_WORDS];
+    Leaf *_leafs[LEAF_COUNT];
     static CapTable _kcaps;
+    // the endpoints to invalidate per VPE
+    static word_t _inveps[AVAIL_PES];
 };
-
 }
@@ -32,6 +32,9 @@ OStream &operator<<(OStream &os, const Capability &cc) {
         case Capability::MSG:
             static_cast<const MsgCapability&>(cc).print(os);
             break;
+        case Capability::MSG | Capability::GROUP:
+            static_cast<const GroupCapability&>(cc).print(os);
+            break;
         case Capability::SERVICE:
             static_cast<const ServiceCapability&>(cc).print(os);
             break;
@@ -63,9 +66,9 @@ SessionObject::~SessionObject() {
 
 Errors::Code MsgCapability::revoke() {
     if(localepid != -1) {
-        KVPE &vpe = PEManager::get().vpe(table()->id() - 1);
-        LOG(IPC, "Invalidating ep " << localepid << " of VPE " << vpe.id() << "@" << vpe.core());
-        vpe.xchg_ep(localepid, nullptr, nullptr);
+        // the endpoints are invalidated in batches at the end of the revoke
+        LOG(IPC, "Invalidating ep " << localepid << " of VPE " << (table()->id() - 1));
+        CapTable::invalidate_later(table()->id() - 1, localepid);
     }
     obj.unref();
     return Errors::NO_ERROR;
@@ -116,6 +119,16 @@ void MemCapability::print(OStream &os) const {
        << ", crd=#" << fmt(obj->credits, "x") << "]";
 }
 
+void GroupCapability::print(OStream &os) const {
+    os << "grp [id=" << table()->id() << ":" << sel() << ", refs=" << obj->refcount()
+       << ", curep=" << localepid << ", dst=";
+    for(size_t i = 0; i < group()->count(); ++i) {
+        const MsgObject *m = group()->members[i].get();
+        os << (i > 0 ? "," : "") << m->core << ":" << m->epid;
+    }
+    os << "]";
+}
+
 void ServiceCapability::print(OStream &os) const {
     os << "serv[id=" << table()->id() << ":" << sel() << ", name=" << inst->name() << "]";
 }
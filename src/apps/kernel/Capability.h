@@ -21,6 +21,7 @@
 #include <m3/DTU.h>
 
 #include "Services.h"
+#include "SlabCache.h"
 
 namespace m3 {
 
@@ -40,6 +41,7 @@ public:
         MSG     = 0x04,
         MEM     = 0x08,
         VPE     = 0x10,
+        GROUP   = 0x20,
     };
 
     explicit Capability(unsigned type) : type(type), _tbl(), _child(), _parent(), _next(), _prev() {
@@ -115,6 +117,22 @@ public:
     virtual ~MemObject();
 };
 
+class GroupObject : public MsgObject {
+public:
+    explicit GroupObject(size_t count)
+        : MsgObject(0, -1, count, static_cast<word_t>(-1)), members(new Reference<MsgObject>[count]) {
+    }
+    virtual ~GroupObject() {
+        delete[] members;
+    }
+
+    size_t count() const {
+        return epid;
+    }
+
+    Reference<MsgObject> *members;
+};
+
 class SessionObject : public RefCounted {
 public:
     explicit SessionObject(Service *_srv, word_t _ident) : RefCounted(), ident(_ident), srv(_srv) {
@@ -126,6 +144,9 @@ public:
 };
 
 class MsgCapability : public Capability {
+public:
+    SLAB_ALLOCATED(MsgCapability)
+
 protected:
     explicit MsgCapability(unsigned type, MsgObject *_obj)
         : Capability(type), localepid(-1), obj(_obj) {
@@ -153,6 +174,8 @@ public:
 
 class MemCapability : public MsgCapability {
 public:
+    SLAB_ALLOCATED(MemCapability)
+
     explicit MemCapability(uintptr_t addr, size_t size, uint perms, int core, int epid)
         : MsgCapability(MEM | MSG, new MemObject(addr, size, perms, core, epid)) {
     }
@@ -167,8 +190,35 @@ private:
     }
 };
 
+/**
+ * A multicast gate: sending over it delivers the message to all members, which have been taken
+ * from msg-capabilities with unlimited credits when the group was created.
+ */
+class GroupCapability : public MsgCapability {
+public:
+    SLAB_ALLOCATED(GroupCapability)
+
+    explicit GroupCapability(GroupObject *grp) : MsgCapability(MSG | GROUP, grp) {
+    }
+
+    const GroupObject *group() const {
+        return static_cast<const GroupObject*>(obj.get());
+    }
+
+    void print(OStream &os) const;
+
+private:
+    virtual Capability *clone() override {
+        GroupCapability *c = new GroupCapability(*this);
+        c->localepid = -1;
+        return c;
+    }
+};
+
 class ServiceCapability : public Capability {
 public:
+    SLAB_ALLOCATED(ServiceCapability)
+
     explicit ServiceCapability(Service *_inst)
         : Capability(SERVICE), inst(_inst) {
     }
@@ -188,6 +238,8 @@ public:
 
 class SessionCapability : public Capability {
 public:
+    SLAB_ALLOCATED(SessionCapability)
+
     explicit SessionCapability(Service *srv, word_t ident)
         : Capability(SESSION), obj(new SessionObject(srv, ident)) {
     }
@@ -206,6 +258,8 @@ public:
 
 class VPECapability : public Capability {
 public:
+    SLAB_ALLOCATED(VPECapability)
+
     explicit VPECapability(KVPE *p);
     VPECapability(const VPECapability &t);
 
@@ -36,6 +36,7 @@ public:
 
     void invalidate_ep(int core, int ep);
     void invalidate_eps(int core);
+    void invalidate_eps(int core, int first, int count);
 
     void config_recv_local(int ep, uintptr_t buf, uint order, uint msgorder, int flags);
     void config_recv_remote(int core, int ep, uintptr_t buf, uint order, uint msgorder, int flags, bool valid);
@@ -19,73 +19,204 @@
 #include <m3/Common.h>
 #include <m3/cap/RecvGate.h>
 #include <m3/cap/SendGate.h>
-#include <m3/util/SList.h>
+#include <m3/util/Profile.h>
 #include <m3/Heap.h>
-#include <stdlib.h>
+#include <m3/Log.h>
+#include <string.h>
 
 namespace m3 {
 
+/**
+ * Queues the messages to a service that can't be sent immediately, because the service has not
+ * yet replied to enough of the previous ones. The messages are copied into a pool of slots that
+ * is allocated together with the queue. Each client has its own FIFO of slots and the clients
+ * with pending messages take turns, so that a single client can't starve the others. Only if
+ * all slots are in use, the messages are put on the heap.
+ */
 class KSendQueue {
-    struct Entry : public SListItem {
-        explicit Entry(RecvGate *_rgate, SendGate *_sgate, const void *_msg, size_t _size)
-            : SListItem(), rgate(_rgate), sgate(_sgate), msg(_msg), size(_size) {
-        }
+public:
+    // the messages to services are derived from syscalls and are thus not larger than the receive
+    // slots for syscalls. KVPE checks that against its SYSC_CREDIT_ORD
+    static constexpr size_t MAX_MSG_SIZE    = 512;
+
+private:
+    static constexpr size_t SLOTS           = 8;
 
+    struct Slot {
+        Slot *next;
         RecvGate *rgate;
-        SendGate *sgate;
-        const void *msg;
         size_t size;
+        cycles_t enqueued;
+        alignas(DTU_PKG_SIZE) char msg[MAX_MSG_SIZE];
     };
 
 public:
-    explicit KSendQueue(int capacity) : _queue(), _capacity(capacity), _inflight(0) {
+    // the client id for messages that the kernel sends on its own behalf
+    static constexpr int KERNEL     = AVAIL_PES;
+    static constexpr int CLIENTS    = AVAIL_PES + 1;
+
+    struct Stats {
+        // the number of messages that have been sent and the number of queued ones among them
+        ulong sent;
+        ulong queued;
+        // the number of queued messages that did not fit into the slots
+        ulong overflows;
+        // the maximum number of queued messages
+        size_t max_depth;
+        // the total and the maximum time a message spent in the queue
+        cycles_t wait;
+        cycles_t max_wait;
+    };
+
+    explicit KSendQueue(int capacity)
+        : _capacity(capacity), _inflight(0), _pending(0), _free(), _heads(), _tails(),
+          _ring(), _ringpos(0), _ringcount(0), _stats() {
+        for(size_t i = 0; i < SLOTS; ++i) {
+            _slots[i].next = _free;
+            _free = _slots + i;
+        }
+    }
+    ~KSendQueue() {
+        for(int c = 0; c < CLIENTS; ++c) {
+            while(Slot *s = _heads[c]) {
+                _heads[c] = s->next;
+                free_slot(s);
+            }
+        }
     }
 
+    KSendQueue(const KSendQueue&) = delete;
+    KSendQueue &operator=(const KSendQueue&) = delete;
+
     int inflight() const {
         return _inflight;
     }
     int pending() const {
-        return _queue.length();
+        return _pending;
+    }
+    const Stats &stats() const {
+        return _stats;
     }
 
-    void send(RecvGate *rgate, SendGate *sgate, const void *msg, size_t size) {
-        if(_inflight < _capacity)
+    /**
+     * Sends the given message via <sgate> or queues it, if there are already <capacity> messages
+     * in flight. The queue takes care of freeing <msg>, if it is on the heap.
+     *
+     * @param client the id of the VPE on whose behalf the message is sent or KERNEL
+     * @param rgate the gate to receive the reply with
+     * @param sgate the gate to the service
+     * @param msg the message
+     * @param size the size of the message (at most MAX_MSG_SIZE)
+     */
+    void send(int client, RecvGate *rgate, SendGate *sgate, const void *msg, size_t size) {
+        assert(client >= 0 && client < CLIENTS);
+        // the callers check the size, because they can still refuse the request
+        if(size > MAX_MSG_SIZE)
+            PANIC("Message to service is too large (" << size << " bytes)");
+        if(_inflight < _capacity) {
             do_send(rgate, sgate, msg, size);
-        else {
-            // if it's not already on the heap, put it there
-            if(!Heap::is_on_heap(msg)) {
-                void *nmsg = Heap::alloc(size);
-                memcpy(nmsg, msg, size);
-                msg = nmsg;
-            }
+            free_msg(msg);
+            return;
+        }
 
-            Entry *e = new Entry(rgate, sgate, msg, size);
-            _queue.append(e);
+        Slot *s = alloc_slot();
+        s->next = nullptr;
+        s->rgate = rgate;
+        s->size = size;
+        s->enqueued = Profile::start();
+        memcpy(s->msg, msg, size);
+        free_msg(msg);
+
+        // if the client had nothing queued, it gets a turn after all others
+        if(_heads[client] == nullptr) {
+            _heads[client] = s;
+            _ring[(_ringpos + _ringcount) % CLIENTS] = client;
+            _ringcount++;
         }
+        else
+            _tails[client]->next = s;
+        _tails[client] = s;
+
+        _stats.queued++;
+        if(++_pending > static_cast<int>(_stats.max_depth))
+            _stats.max_depth = _pending;
     }
 
-    void received_reply() {
+    /**
+     * Notifies the queue that the service has replied to one message, so that the first queued
+     * message of the next client can be sent.
+     *
+     * @param sgate the gate to the service
+     */
+    void received_reply(SendGate *sgate) {
         assert(_inflight > 0);
         _inflight--;
-        Entry *e = _queue.remove_first();
-        if(e) {
-            do_send(e->rgate, e->sgate, e->msg, e->size);
-            delete e;
-        }
+        if(_ringcount == 0)
+            return;
+
+        int client = _ring[_ringpos];
+        _ringpos = (_ringpos + 1) % CLIENTS;
+        _ringcount--;
+
+        Slot *s = _heads[client];
+        _heads[client] = s->next;
+        if(_heads[client])
+            _ring[(_ringpos + _ringcount++) % CLIENTS] = client;
+        _pending--;
+
+        cycles_t wait = Profile::stop() - s->enqueued;
+        _stats.wait += wait;
+        if(wait > _stats.max_wait)
+            _stats.max_wait = wait;
+
+        do_send(s->rgate, sgate, s->msg, s->size);
+        free_slot(s);
     }
 
 private:
     void do_send(RecvGate *rgate, SendGate *sgate, const void *msg, size_t size) {
         sgate->receive_gate(rgate);
         sgate->send_sync(msg, size);
+        _inflight++;
+        _stats.sent++;
+    }
+
+    static void free_msg(const void *msg) {
         if(Heap::is_on_heap(msg))
             Heap::free(const_cast<void*>(msg));
-        _inflight++;
     }
 
-    SList<Entry> _queue;
+    Slot *alloc_slot() {
+        if(_free) {
+            Slot *s = _free;
+            _free = s->next;
+            return s;
+        }
+        _stats.overflows++;
+        return static_cast<Slot*>(Heap::alloc(sizeof(Slot)));
+    }
+    void free_slot(Slot *s) {
+        if(s >= _slots && s < _slots + SLOTS) {
+            s->next = _free;
+            _free = s;
+        }
+        else
+            Heap::free(s);
+    }
+
     int _capacity;
     int _inflight;
+    int _pending;
+    Slot *_free;
+    // the FIFO of queued messages per client
+    Slot *_heads[CLIENTS];
+    Slot *_tails[CLIENTS];
+    // the clients with queued messages in the order in which they get their turn
+    int _ring[CLIENTS];
+    int _ringpos;
+    int _ringcount;
+    Stats _stats;
+    Slot _slots[SLOTS];
 };
 
 }
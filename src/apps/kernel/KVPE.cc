@@ -26,7 +26,8 @@ KVPE::KVPE(String &&prog, size_t id)
       _caps(id + 1),
       _sepsgate(MemGate::bind(VPE::self().alloc_cap(), Cap::KEEP_CAP)),
       _syscgate(SyscallHandler::get().create_gate(this)),
-      _srvgate(RecvGate::create(SyscallHandler::get().srvrcvbuf())), _requires() {
+      _srvgate(RecvGate::create(SyscallHandler::get().srvrcvbuf())), _requires(),
+      _exitsubscr(), _statsnap() {
     _caps.set(0, new VPECapability(this));
     _caps.set(1, new MemCapability(0, (size_t)-1, MemGate::RWX, core(), 0));
 
@@ -41,6 +42,18 @@ void KVPE::unref() {
         PEManager::get().remove(_id);
 }
 
+void KVPE::invalidate_eps(word_t eps) {
+    // invalidate each range of consecutive endpoints at once
+    while(eps) {
+        int first = __builtin_ctzl(eps);
+        int count = __builtin_ctzl(~(eps >> first));
+        LOG(IPC, "Invalidating eps " << first << ".." << (first + count - 1)
+            << " of VPE " << id() << "@" << core());
+        KDTU::get().invalidate_eps(core(), first, count);
+        eps &= ~(((static_cast<word_t>(1) << count) - 1) << first);
+    }
+}
+
 void KVPE::exit(int exitcode) {
     KDTU::get().invalidate_eps(core());
     detach_rbufs();
@@ -19,6 +19,7 @@
 #include <m3/util/SList.h>
 #include <m3/server/RequestHandler.h>
 #include <m3/cap/MemGate.h>
+#include <m3/Syscalls.h>
 #include <m3/Log.h>
 #include <cstring>
 
@@ -40,7 +41,15 @@ public:
         String name;
     };
 
+    // the statistics of a syscall that SYSCSTAT hands out in multiple replies
+    struct StatSnapshot {
+        Syscalls::Operation op;
+        Syscalls::Stat stat;
+    };
+
     static constexpr int SYSC_CREDIT_ORD    = nextlog2<512>::val;
+    static_assert((1 << SYSC_CREDIT_ORD) <= KSendQueue::MAX_MSG_SIZE,
+        "Messages to services might not fit into the send queue");
 
     explicit KVPE(String &&prog, size_t id);
     KVPE(const KVPE &) = delete;
@@ -60,6 +69,7 @@ public:
 
     void activate_sysc_ep(void *addr);
     Errors::Code xchg_ep(size_t epid, MsgCapability *oldcapobj, MsgCapability *newcapobj);
+    void invalidate_eps(word_t eps);
 
     int id() const {
         return _id;
@@ -103,9 +113,21 @@ public:
     MemGate &seps_gate() {
         return _sepsgate;
     }
+    StatSnapshot *stat_snapshot() {
+        return _statsnap;
+    }
+    void stat_snapshot(StatSnapshot *snap) {
+        delete _statsnap;
+        _statsnap = snap;
+    }
+#if defined(__host__)
+    /**
+     * @param p the parameters to fill for the process of this VPE
+     */
+    void params(Config::Params &p);
+#endif
 
 private:
-    void write_env_file(int pid, label_t label, size_t epid);
     void activate_sysc_ep();
 
     void free_reqs() {
@@ -131,6 +153,7 @@ private:
     RecvGate _srvgate;
     SList<ServName> _requires;
     Subscriptions<int> _exitsubscr;
+    StatSnapshot *_statsnap;
 };
 
 }
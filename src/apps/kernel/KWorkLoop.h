@@ -17,24 +17,38 @@
 #pragma once
 
 #include <m3/tracing/Tracing.h>
+#include <m3/util/Profile.h>
 #include <m3/Common.h>
 #include <m3/WorkLoop.h>
 
 #include "SyscallHandler.h"
 
 #if defined(__host__)
+#include <atomic>
+#include <pthread.h>
+#include <signal.h>
+#include <cstring>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/stat.h>
 
 static int sigchilds = 0;
+static volatile sig_atomic_t dumpstats = 0;
+static struct sigaction dtuquit;
 
 static void sigchild(int) {
     sigchilds++;
     signal(SIGCHLD, sigchild);
 }
 
+static void sigquit(int sig) {
+    // like the DTU, print the syscall statistics on SIGQUIT; but not in the signal handler
+    dumpstats = 1;
+    if(dtuquit.sa_handler != SIG_DFL && dtuquit.sa_handler != SIG_IGN)
+        dtuquit.sa_handler(sig);
+}
+
 static void check_childs() {
     for(; sigchilds > 0; sigchilds--) {
         int status;
@@ -57,40 +71,196 @@ class KWorkLoop {
     KWorkLoop() = delete;
 
 public:
-    static void run() {
+    // the default number of messages to handle per wakeup
+    static constexpr size_t DEF_BUDGET  = 32;
+
+    /**
+     * Holds the kernel lock while it exists. On host, syscalls may be received by multiple threads
+     * (see SyscallHandler::set_workers). The rule is: all messages from services and all syscalls
+     * but NOOP are handled with the kernel lock held, because they touch kernel state and use the
+     * DTU's command registers. NOOP does neither, so that it is answered without the lock via the
+     * DTU's command queue. Elsewhere, there is only one thread and the lock does nothing.
+     */
+    class Guard {
+    public:
+        explicit Guard() {
+#if defined(__host__)
+            pthread_mutex_lock(&lock());
+#endif
+        }
+        ~Guard() {
+#if defined(__host__)
+            pthread_mutex_unlock(&lock());
+#endif
+        }
+    };
+
+    /**
+     * Runs the kernel's work-loop until there is nothing left to do. After each wakeup, it handles
+     * up to <budget> messages, alternating between the syscall and service receive buffers. It only
+     * waits again if both receive buffers are empty. The additional syscall workers, if any, are
+     * started before and stopped afterwards.
+     *
+     * @param budget the maximum number of messages to handle per wakeup
+     */
+    static void run(size_t budget = DEF_BUDGET) {
 #if defined(__host__)
         signal(SIGCHLD, sigchild);
+        struct sigaction act;
+        memset(&act, 0, sizeof(act));
+        act.sa_handler = sigquit;
+        act.sa_flags = SA_RESTART;
+        sigaction(SIGQUIT, &act, &dtuquit);
 #endif
         EVENT_TRACER_KWorkLoop_run();
+        if(budget == 0)
+            budget = 1;
 
-        WorkLoop &wl = WorkLoop::get();
         DTU &dtu = DTU::get();
         SyscallHandler &sysch = SyscallHandler::get();
-        int sysep = sysch.epid();
+        int sysep = sysch.epid(0);
         int srvep = sysch.srvepid();
-        while(wl.has_items()) {
-            DTU::get().wait();
-
-            if(dtu.fetch_msg(sysep)) {
-                // we know the subscriber here, so optimize that a bit
-                DTU::Message *msg = dtu.message(sysep);
-                RecvGate *rgate = reinterpret_cast<RecvGate*>(msg->label);
-                sysch.handle_message(*rgate, nullptr);
-                dtu.ack_message(sysep);
-                EVENT_TRACE_FLUSH_LIGHT();
-            }
-            if(dtu.fetch_msg(srvep)) {
-                DTU::Message *msg = dtu.message(srvep);
-                RecvGate *gate = reinterpret_cast<RecvGate*>(msg->label);
-                gate->notify_all();
-                dtu.ack_message(srvep);
+        start_workers();
+
+        bool drained = true;
+        while(running()) {
+            // if we stopped because of the budget, there are still messages left
+            if(drained)
+                DTU::get().wait();
+
+            drained = false;
+            size_t handled = 0;
+            while(handled < budget) {
+                bool found = false;
+                if(dtu.fetch_msg(sysep)) {
+                    if(!handle_syscall(dtu, sysch, 0, sysep))
+                        break;
+                    found = true;
+                    handled++;
+                }
+                if(dtu.fetch_msg(srvep)) {
+                    Guard g;
+                    if(!WorkLoop::get().has_items())
+                        break;
+                    DTU::Message *msg = dtu.message(srvep);
+                    RecvGate *gate = reinterpret_cast<RecvGate*>(msg->label);
+                    gate->notify_all();
+                    dtu.ack_message(srvep);
+                    found = true;
+                    handled++;
+                }
+
+                if(!found) {
+                    drained = true;
+                    break;
+                }
             }
 
 #if defined(__host__)
             check_childs();
+            if(dumpstats) {
+                Guard g;
+                dumpstats = 0;
+                sysch.dump_stats();
+            }
+#endif
+        }
+
+        stop_workers();
+    }
+
+private:
+    static bool running() {
+        Guard g;
+        return WorkLoop::get().has_items();
+    }
+
+    /**
+     * Handles the syscall at the current position of receive buffer <ep> of worker <worker>.
+     *
+     * @return false if the kernel is shutting down and the syscall has therefore been ignored
+     */
+    static bool handle_syscall(DTU &dtu, SyscallHandler &sysch, size_t worker, int ep) {
+        DTU::Message *msg = dtu.message(ep);
+#if defined(__host__)
+        if(sysch.workers() > 1 &&
+                *reinterpret_cast<const Syscalls::Operation*>(msg->data) == Syscalls::NOOP) {
+            cycles_t start = Profile::start();
+            // reply and ack via the command queue, so that we neither need the lock nor the gate
+            alignas(DTU_PKG_SIZE) word_t reply = Errors::NO_ERROR;
+            dtu.reply_async(ep, &reply, sizeof(reply), dtu.get_msgoff(ep, nullptr, msg));
+            // commands are executed in order; thus, the reply is done if the ack is done
+            dtu.wait_for_cmd(dtu.ack_message_async(ep));
+            sysch.record(worker, Syscalls::NOOP, Profile::stop() - start);
+            return true;
+        }
 #endif
+
+        Guard g;
+        if(!WorkLoop::get().has_items())
+            return false;
+        // we know the subscriber here, so optimize that a bit
+        sysch.handle_syscall(worker, msg);
+        dtu.ack_message(ep);
+        EVENT_TRACE_FLUSH_LIGHT();
+        return true;
+    }
+
+#if defined(__host__)
+    static pthread_mutex_t &lock() {
+        static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        return mutex;
+    }
+    static std::atomic<bool> &stopped() {
+        static std::atomic<bool> flag(false);
+        return flag;
+    }
+    static pthread_t *threads() {
+        static pthread_t tids[SyscallHandler::MAX_WORKERS];
+        return tids;
+    }
+
+    static void *worker(void *arg) {
+        DTU &dtu = DTU::get();
+        SyscallHandler &sysch = SyscallHandler::get();
+        size_t id = reinterpret_cast<size_t>(arg);
+        int ep = sysch.epid(id);
+        uint32_t seq = 0;
+        while(!stopped()) {
+            if(!dtu.fetch_msg(ep))
+                dtu.wait(seq);
+            else if(!handle_syscall(dtu, sysch, id, ep))
+                break;
+        }
+        return nullptr;
+    }
+
+    static void start_workers() {
+        // signals are handled by the main thread only
+        sigset_t sigs, old;
+        sigemptyset(&sigs);
+        sigaddset(&sigs, SIGCHLD);
+        sigaddset(&sigs, SIGINT);
+        sigaddset(&sigs, SIGQUIT);
+        pthread_sigmask(SIG_BLOCK, &sigs, &old);
+        for(size_t i = 1; i < SyscallHandler::get().workers(); ++i) {
+            if(pthread_create(threads() + i, nullptr, worker, reinterpret_cast<void*>(i)) != 0)
+                PANIC("Unable to create syscall worker " << i);
         }
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
     }
+
+    static void stop_workers() {
+        stopped() = true;
+        for(size_t i = 1; i < SyscallHandler::get().workers(); ++i)
+            pthread_join(threads()[i], nullptr);
+    }
+#else
+    static void start_workers() {
+    }
+    static void stop_workers() {
+    }
+#endif
 };
 
 }
@@ -14,93 +14,265 @@
  * General Public License version 2 for more details.
  */
 
+#include <m3/util/Math.h>
+#include <m3/util/Random.h>
 #include <assert.h>
+
 #include "MemoryMap.h"
 
 namespace m3 {
 
-MemoryMap::MemoryMap(uintptr_t addr, size_t size) : list(new Area()) {
-    list->addr = addr;
-    list->size = size;
-    list->next = nullptr;
+MemoryMap::MemoryMap(uintptr_t addr, size_t size) : _root(), _classmask(), _classes() {
+    if(size > 0)
+        free(addr, size);
 }
 
 MemoryMap::~MemoryMap() {
-    for(Area *a = list; a != nullptr;) {
-        Area *n = a->next;
+    delete_rec(_root);
+    _root = nullptr;
+}
+
+void MemoryMap::delete_rec(Area *a) {
+    if(a) {
+        delete_rec(a->left);
+        delete_rec(a->right);
         delete a;
-        a = n;
     }
-    list = nullptr;
 }
 
-uintptr_t MemoryMap::allocate(size_t size) {
-    Area *a;
-    Area *p = nullptr;
-    for(a = list; a != nullptr; p = a, a = a->next) {
-        if(a->size >= size)
-            break;
-    }
+uintptr_t MemoryMap::allocate(size_t size, size_t align) {
+    if(size == 0)
+        return -1;
+
+    Area *a = find_fit(size, align);
     if(a == nullptr)
         return -1;
 
+    uintptr_t res = Math::round_up<uintptr_t>(a->addr, align);
+    size_t front = res - a->addr;
+    size_t back = a->addr + a->size - (res + size);
+
+    list_remove(a);
     /* take it from the front */
-    uintptr_t res = a->addr;
-    a->size -= size;
-    a->addr += size;
-    /* if the area is empty now, remove it */
-    if(a->size == 0) {
-        if(p)
-            p->next = a->next;
-        else
-            list = a->next;
-        delete a;
+    if(front == 0) {
+        /* if the area is empty now, remove it */
+        if(back == 0) {
+            tree_remove(&_root, a);
+            delete a;
+        }
+        else {
+            // the order in the tree does not change by that
+            a->addr += size;
+            a->size = back;
+            list_insert(a);
+        }
+    }
+    /* keep the part in front of the aligned address and put the rest into a new area */
+    else {
+        a->size = front;
+        list_insert(a);
+        if(back > 0) {
+            Area *n = new Area();
+            n->addr = res + size;
+            n->size = back;
+            tree_insert(&_root, n);
+            list_insert(n);
+        }
     }
     return res;
 }
 
 void MemoryMap::free(uintptr_t addr, size_t size) {
-    /* find the area behind ours */
-    Area *n, *p = nullptr;
-    for(n = list; n != nullptr && addr > n->addr; p = n, n = n->next)
-        ;
+    if(size == 0)
+        return;
+
+    Area *p, *n;
+    find_neighbors(addr, &p, &n);
 
     /* merge with prev and next */
     if(p && p->addr + p->size == addr && n && addr + size == n->addr) {
+        list_remove(p);
+        list_remove(n);
         p->size += size + n->size;
-        p->next = n->next;
+        tree_remove(&_root, n);
         delete n;
+        list_insert(p);
     }
     /* merge with prev */
     else if(p && p->addr + p->size == addr) {
+        list_remove(p);
         p->size += size;
+        list_insert(p);
     }
     /* merge with next */
     else if(n && addr + size == n->addr) {
+        list_remove(n);
         n->addr -= size;
         n->size += size;
+        list_insert(n);
     }
     /* create new area between them */
     else {
         Area *a = new Area();
         a->addr = addr;
         a->size = size;
-        if(p)
-            p->next = a;
-        else
-            list = a;
-        a->next = n;
+        tree_insert(&_root, a);
+        list_insert(a);
     }
 }
 
 size_t MemoryMap::get_size(size_t *areas) const {
     size_t total = 0;
     *areas = 0;
-    for(Area *a = list; a != nullptr; a = a->next) {
-        total += a->size;
-        (*areas)++;
+    for(size_t c = 0; c < CLASSES; ++c) {
+        for(Area *a = _classes[c]; a != nullptr; a = a->next) {
+            total += a->size;
+            (*areas)++;
+        }
     }
     return total;
 }
 
+size_t MemoryMap::largest() const {
+    if(_classmask == 0)
+        return 0;
+
+    size_t max = 0;
+    size_t c = size_class(_classmask);
+    for(Area *a = _classes[c]; a != nullptr; a = a->next)
+        max = Math::max(max, a->size);
+    return max;
+}
+
+uint MemoryMap::fragmentation() const {
+    size_t areas;
+    size_t total = get_size(&areas);
+    if(total == 0)
+        return 0;
+    return 100 - static_cast<uint64_t>(largest()) * 100 / total;
+}
+
+MemoryMap::Area *MemoryMap::find_fit(size_t size, size_t align) {
+    // all areas in the size-class <fit> and above are large enough, regardless of their alignment
+    size_t need = size + align - 1;
+    if(need < size)
+        return nullptr;
+    size_t fit = size_class(need);
+    if(need & (need - 1))
+        fit++;
+
+    size_t mask = fit < CLASSES ? _classmask & (~static_cast<size_t>(0) << fit) : 0;
+    if(mask)
+        return _classes[__builtin_ctzl(mask)];
+
+    // otherwise, search through the smaller classes that might contain a suitable area
+    for(size_t c = size_class(size); c < Math::min(fit, CLASSES); ++c) {
+        for(Area *a = _classes[c]; a != nullptr; a = a->next) {
+            uintptr_t start = Math::round_up<uintptr_t>(a->addr, align);
+            if(start >= a->addr && start - a->addr + size <= a->size)
+                return a;
+        }
+    }
+    return nullptr;
+}
+
+void MemoryMap::find_neighbors(uintptr_t addr, Area **prev, Area **next) {
+    *prev = *next = nullptr;
+    for(Area *a = _root; a != nullptr; ) {
+        if(addr < a->addr) {
+            *next = a;
+            a = a->left;
+        }
+        else {
+            assert(addr > a->addr);
+            *prev = a;
+            a = a->right;
+        }
+    }
+}
+
+void MemoryMap::tree_insert(Area **root, Area *a) {
+    Area *r = *root;
+    if(r == nullptr) {
+        a->prio = Random::get();
+        a->left = a->right = nullptr;
+        *root = a;
+        return;
+    }
+
+    // insert it as a leaf and rotate it up until the heap-property holds again
+    if(a->addr < r->addr) {
+        tree_insert(&r->left, a);
+        if(r->left->prio > r->prio) {
+            Area *l = r->left;
+            r->left = l->right;
+            l->right = r;
+            *root = l;
+        }
+    }
+    else {
+        tree_insert(&r->right, a);
+        if(r->right->prio > r->prio) {
+            Area *rr = r->right;
+            r->right = rr->left;
+            rr->left = r;
+            *root = rr;
+        }
+    }
+}
+
+void MemoryMap::tree_remove(Area **root, Area *a) {
+    while(*root != a)
+        root = a->addr < (*root)->addr ? &(*root)->left : &(*root)->right;
+
+    // rotate it down until it has at most one child
+    while(a->left && a->right) {
+        if(a->left->prio > a->right->prio) {
+            Area *l = a->left;
+            a->left = l->right;
+            l->right = a;
+            *root = l;
+            root = &l->right;
+        }
+        else {
+            Area *r = a->right;
+            a->right = r->left;
+            r->left = a;
+            *root = r;
+            root = &r->left;
+        }
+    }
+    *root = a->left ? a->left : a->right;
+}
+
+void MemoryMap::list_insert(Area *a) {
+    size_t c = size_class(a->size);
+    a->prev = nullptr;
+    a->next = _classes[c];
+    if(a->next)
+        a->next->prev = a;
+    _classes[c] = a;
+    _classmask |= static_cast<size_t>(1) << c;
+}
+
+void MemoryMap::list_remove(Area *a) {
+    size_t c = size_class(a->size);
+    if(a->prev)
+        a->prev->next = a->next;
+    else
+        _classes[c] = a->next;
+    if(a->next)
+        a->next->prev = a->prev;
+    if(_classes[c] == nullptr)
+        _classmask &= ~(static_cast<size_t>(1) << c);
+}
+
+void MemoryMap::print_rec(OStream &os, const Area *a) {
+    if(a) {
+        print_rec(os, a->left);
+        os << "\t@ " << fmt(a->addr, "p") << ", " << (a->size / 1024) << " KiB\n";
+        print_rec(os, a->right);
+    }
+}
+
 }
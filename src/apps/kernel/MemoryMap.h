@@ -21,10 +21,25 @@
 
 namespace m3 {
 
+/**
+ * Manages the free areas of a memory region. The areas are kept in free-lists per size-class
+ * (power of two) to find a fitting area quickly and additionally in a tree, ordered by address, to
+ * merge freed areas with their neighbors. Thus, both allocate and free take O(log n) steps
+ * (except for allocations that only fit into an area of the same size-class, which requires a
+ * search through that class).
+ */
 class MemoryMap {
+    static constexpr size_t CLASSES     = sizeof(size_t) * 8;
+
     struct Area {
         uintptr_t addr;
         size_t size;
+        // the address-tree (treap)
+        int prio;
+        Area *left;
+        Area *right;
+        // the list of the size-class
+        Area *prev;
         Area *next;
     };
 
@@ -45,16 +60,15 @@ public:
     /**
      * Allocates an area in the given map, that is <size> bytes large.
      *
-     * @param map the map
      * @param size the size of the area
+     * @param align the alignment of the area (a power of two)
      * @return the address of -1 if failed
      */
-    uintptr_t allocate(size_t size);
+    uintptr_t allocate(size_t size, size_t align = 1);
 
     /**
      * Frees the area at <addr> with <size> bytes.
      *
-     * @param map the map
      * @param addr the address of the area
      * @param size the size of the area
      */
@@ -63,22 +77,49 @@ public:
     /**
      * Just for debugging/testing: Determines the total number of free bytes in the map
      *
-     * @param map the map
      * @param areas will be set to the number of areas in the map
      * @return the free bytes
      */
     size_t get_size(size_t *areas) const;
 
+    /**
+     * @return the size of the largest free area
+     */
+    size_t largest() const;
+
+    /**
+     * @return the fragmentation in percent, i.e. how much of the free memory is not part of the
+     *  largest free area
+     */
+    uint fragmentation() const;
+
     friend OStream &operator<<(OStream &os, const MemoryMap &map) {
         size_t areas;
-        os << "Total: " << (map.get_size(&areas) / 1024) << " KiB:\n";
-        for(Area *a = map.list; a != nullptr; a = a->next)
-            os << "\t@ " << fmt(a->addr, "p") << ", " << (a->size / 1024) << " KiB\n";
+        os << "Total: " << (map.get_size(&areas) / 1024) << " KiB in " << areas << " areas"
+           << " (largest: " << (map.largest() / 1024) << " KiB"
+           << ", fragmentation: " << map.fragmentation() << "%):\n";
+        print_rec(os, map._root);
         return os;
     }
 
 private:
-    Area *list;
+    static size_t size_class(size_t size) {
+        return sizeof(size_t) * 8 - 1 - __builtin_clzl(size);
+    }
+    static void print_rec(OStream &os, const Area *a);
+    static void delete_rec(Area *a);
+
+    Area *find_fit(size_t size, size_t align);
+    void find_neighbors(uintptr_t addr, Area **prev, Area **next);
+    void tree_insert(Area **root, Area *a);
+    void tree_remove(Area **root, Area *a);
+    void list_insert(Area *a);
+    void list_remove(Area *a);
+
+    Area *_root;
+    // a bit for every non-empty size-class
+    size_t _classmask;
+    Area *_classes[CLASSES];
 };
 
 }
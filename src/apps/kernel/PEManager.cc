@@ -33,7 +33,7 @@ PEManager::PEManager(int argc, char **argv)
             continue;
 
         // find next usable PE
-        while((PE_MASK & (1 << no)) == 0)
+        while((PE_MASK & (1ULL << no)) == 0)
             no++;
 
         // for idle, don't create a VPE
@@ -59,12 +59,10 @@ PEManager::PEManager(int argc, char **argv)
                 break;
         }
 
-        // start it, or register pending item
+        // start it, or register a waiter for each missing requirement
         if(strcmp(argv[i], "idle") != 0) {
-            if(_vpes[no]->requirements().length() == 0)
-                _vpes[no]->start(end - i, argv + i, 0);
-            else
-                _pending.append(new Pending(_vpes[no], end - i, argv + i));
+            Pending *p = new Pending(_vpes[no], end - i, argv + i);
+            start_or_wait(p);
         }
 
         no++;
@@ -74,6 +72,36 @@ PEManager::PEManager(int argc, char **argv)
     }
 }
 
+void PEManager::start_or_wait(Pending *p) {
+    for(auto &r : p->vpe->requirements()) {
+        if(!ServiceList::get().find(r.name)) {
+            size_t idx = ServiceList::hash(r.name) % WAIT_BUCKETS;
+            _waiters[idx].append(new Waiter(r.name, p));
+            p->missing++;
+        }
+    }
+    if(p->missing == 0) {
+        p->vpe->start(p->argc, p->argv, 0);
+        delete p;
+    }
+}
+
+void PEManager::start_pending(const String &name) {
+    SList<Waiter> &bucket = _waiters[ServiceList::hash(name) % WAIT_BUCKETS];
+    for(auto it = bucket.begin(); it != bucket.end(); ) {
+        auto old = it++;
+        if(old->name == name) {
+            Pending *p = old->pending;
+            bucket.remove(&*old);
+            delete &*old;
+
+            // the services that were there before might have gone in the meantime
+            if(--p->missing == 0)
+                start_or_wait(p);
+        }
+    }
+}
+
 void PEManager::shutdown() {
     ServiceList &serv = ServiceList::get();
     for(auto &s : serv) {
@@ -119,7 +147,7 @@ KVPE *PEManager::create(String &&name, const char *core) {
 
     size_t i;
     for(i = 0; i < AVAIL_PES; ++i) {
-        if((PE_MASK & (1 << i)) && _vpes[i] == nullptr && core_matches(i, core))
+        if((PE_MASK & (1ULL << i)) && _vpes[i] == nullptr && core_matches(i, core))
             break;
     }
     if(i == AVAIL_PES)
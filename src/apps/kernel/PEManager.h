@@ -31,16 +31,30 @@ class KVPE;
 class PEManager {
     friend class KVPE;
 
-    struct Pending : public SListItem {
+    struct Pending {
         explicit Pending(KVPE *_vpe, int _argc, char **_argv)
-            : vpe(_vpe), argc(_argc), argv(_argv) {
+            : vpe(_vpe), argc(_argc), argv(_argv), missing() {
         }
 
         KVPE *vpe;
         int argc;
         char **argv;
+        // the number of required services that do not exist yet
+        size_t missing;
     };
 
+    // a pending VPE waiting for the service <name>. hashed by the name of the service
+    struct Waiter : public SListItem {
+        explicit Waiter(const String &_name, Pending *_pending)
+            : name(_name), pending(_pending) {
+        }
+
+        String name;
+        Pending *pending;
+    };
+
+    static constexpr size_t WAIT_BUCKETS    = 32;
+
 public:
     static void create(int argc, char **argv) {
         _inst = new PEManager(argc, argv);
@@ -86,35 +100,27 @@ public:
         return *_vpes[id];
     }
 
-    void start_pending(ServiceList &serv) {
-        for(auto it = _pending.begin(); it != _pending.end(); ) {
-            bool fullfilled = true;
-            for(auto &r : it->vpe->requirements()) {
-                if(!serv.find(r.name)) {
-                    fullfilled = false;
-                    break;
-                }
-            }
-
-            if(fullfilled) {
-                auto old = it++;
-                old->vpe->start(old->argc, old->argv, 0);
-                _pending.remove(&*old);
-                delete &*old;
-            }
-            else
-                it++;
-        }
-    }
+    /**
+     * Starts all pending VPEs whose last missing requirement is the service <name>, which has
+     * just been registered.
+     *
+     * @param name the name of the new service
+     */
+    void start_pending(const String &name);
 
 private:
     void deprivilege_pes() {
         for(int i = 0; i < AVAIL_PES; ++i) {
-            if(PE_MASK & (1 << i))
+            if(PE_MASK & (1ULL << i))
                 KDTU::get().deprivilege(APP_CORES + i);
         }
     }
 
+    /**
+     * Starts the VPE of <p>, if all its requirements exist. Otherwise, it waits for the missing
+     * ones.
+     */
+    void start_or_wait(Pending *p);
     bool core_matches(size_t i, const char *core) const;
     static m3::String path_to_name(const m3::String &path, const char *suffix);
     static m3::String fork_name(const m3::String &name);
@@ -123,7 +129,7 @@ private:
     KVPE *_vpes[AVAIL_PES];
     size_t _count;
     size_t _daemons;
-    SList<Pending> _pending;
+    SList<Waiter> _waiters[WAIT_BUCKETS];
     static PEManager *_inst;
 };
 
@@ -40,7 +40,7 @@ void ServiceList::send_and_receive(Reference<Service> serv, const void *msg, siz
         delete rgatecpy;
     });
 
-    serv->send(rgate, msg, size);
+    serv->send(KSendQueue::KERNEL, rgate, msg, size);
 }
 
 }
@@ -32,10 +32,14 @@ class KVPE;
 class Gate;
 
 class Service : public m3::SListItem, public RefCounted {
+    friend class ServiceList;
+
 public:
-    explicit Service(KVPE &vpe, int sel, const m3::String &name, capsel_t gate, int capacity)
+    explicit Service(KVPE &vpe, int sel, const m3::String &name, capsel_t gate, size_t msgsize,
+                     int capacity)
         : m3::SListItem(), RefCounted(), closing(), _vpe(vpe), _sel(sel), _name(name),
-          _sgate(m3::SendGate::bind(gate, nullptr, m3::Cap::KEEP_CAP)), _queue(capacity) {
+          _sgate(m3::SendGate::bind(gate, nullptr, m3::Cap::KEEP_CAP)), _msgsize(msgsize),
+          _queue(capacity), _hnext() {
     }
     ~Service();
 
@@ -52,14 +56,23 @@ public:
         return const_cast<m3::SendGate&>(_sgate);
     }
 
+    /**
+     * @return the maximum size of the messages that can be sent to the service
+     */
+    size_t msgsize() const {
+        return _msgsize;
+    }
     int pending() const {
         return _queue.inflight() + _queue.pending();
     }
-    void send(RecvGate *rgate, const void *msg, size_t size) {
-        _queue.send(rgate, &_sgate, msg, size);
+    const KSendQueue::Stats &queue_stats() const {
+        return _queue.stats();
+    }
+    void send(int client, RecvGate *rgate, const void *msg, size_t size) {
+        _queue.send(client, rgate, &_sgate, msg, size);
     }
     void received_reply() {
-        _queue.received_reply();
+        _queue.received_reply(&_sgate);
     }
 
     bool closing;
@@ -69,11 +82,20 @@ private:
     int _sel;
     m3::String _name;
     m3::SendGate _sgate;
+    size_t _msgsize;
     KSendQueue _queue;
+    // the next service in the same bucket of the ServiceList
+    Service *_hnext;
 };
 
+/**
+ * The list of all services. Besides the list, the services are kept in a hash table by name,
+ * because the name is used to find a service for every session creation.
+ */
 class ServiceList {
-    explicit ServiceList() : _list() {
+    static constexpr size_t BUCKETS = 32;
+
+    explicit ServiceList() : _list(), _buckets() {
     }
 
 public:
@@ -85,6 +107,17 @@ public:
         return _inst;
     }
 
+    /**
+     * @param name the name
+     * @return the hash of the given name (FNV-1a)
+     */
+    static uint32_t hash(const m3::String &name) {
+        uint32_t h = 2166136261U;
+        for(const char *c = name.c_str(); *c; ++c)
+            h = (h ^ static_cast<unsigned char>(*c)) * 16777619U;
+        return h;
+    }
+
     iterator begin() {
         return _list.begin();
     }
@@ -92,15 +125,19 @@ public:
         return _list.end();
     }
 
-    Service *add(KVPE &vpe, int sel, const m3::String &name, capsel_t gate, int capacity) {
-        Service *inst = new Service(vpe, sel, name, gate, capacity);
+    Service *add(KVPE &vpe, int sel, const m3::String &name, capsel_t gate, size_t msgsize,
+                 int capacity) {
+        Service *inst = new Service(vpe, sel, name, gate, msgsize, capacity);
         _list.append(inst);
+        Service *&head = _buckets[hash(name) % BUCKETS];
+        inst->_hnext = head;
+        head = inst;
         return inst;
     }
     Service *find(const m3::String &name) {
-        for(auto &s : _list) {
-            if(s.name() == name)
-                return &s;
+        for(Service *s = _buckets[hash(name) % BUCKETS]; s != nullptr; s = s->_hnext) {
+            if(s->name() == name)
+                return s;
         }
         return nullptr;
     }
@@ -109,9 +146,14 @@ public:
 private:
     void remove(Service *inst) {
         _list.remove(inst);
+        Service **s = &_buckets[hash(inst->name()) % BUCKETS];
+        while(*s != inst)
+            s = &(*s)->_hnext;
+        *s = inst->_hnext;
     }
 
     m3::SList<Service> _list;
+    Service *_buckets[BUCKETS];
     static ServiceList _inst;
 };
 
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <m3/Common.h>
+#include <m3/Heap.h>
+
+namespace m3 {
+
+/**
+ * A cache of objects of type T. Free objects are kept in a list and new ones are allocated in
+ * chunks of <PER_CHUNK> objects, so that allocating and freeing an object is a constant time
+ * operation. The chunks are never given back to the heap.
+ */
+template<class T, size_t PER_CHUNK = 32>
+class SlabCache {
+    union Slot {
+        Slot *next;
+        alignas(T) char object[sizeof(T)];
+    };
+
+public:
+    static void *alloc() {
+        if(_free == nullptr)
+            refill();
+        Slot *s = _free;
+        _free = s->next;
+        return s;
+    }
+    static void free(void *ptr) {
+        Slot *s = static_cast<Slot*>(ptr);
+        s->next = _free;
+        _free = s;
+    }
+
+private:
+    static void refill() {
+        Slot *chunk = static_cast<Slot*>(Heap::alloc(sizeof(Slot) * PER_CHUNK));
+        for(size_t i = 0; i < PER_CHUNK - 1; ++i)
+            chunk[i].next = chunk + i + 1;
+        chunk[PER_CHUNK - 1].next = nullptr;
+        _free = chunk;
+    }
+
+    static Slot *_free;
+};
+
+template<class T, size_t PER_CHUNK>
+typename SlabCache<T, PER_CHUNK>::Slot *SlabCache<T, PER_CHUNK>::_free = nullptr;
+
+}
+
+/**
+ * Allocates the objects of class <T> from a SlabCache. As the cache depends on the size, this
+ * has to be used in every class that is instantiated, not only in the base class.
+ */
+#define SLAB_ALLOCATED(T)                                                   \
+    static void *operator new(size_t size) {                                \
+        assert(size == sizeof(T));                                          \
+        static_cast<void>(size);                                            \
+        return m3::SlabCache<T>::alloc();                                   \
+    }                                                                       \
+    static void operator delete(void *ptr) {                                \
+        m3::SlabCache<T>::free(ptr);                                        \
+    }
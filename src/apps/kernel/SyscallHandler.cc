@@ -15,6 +15,8 @@
  */
 
 #include <m3/tracing/Tracing.h>
+#include <m3/util/Math.h>
+#include <m3/util/Profile.h>
 #include <m3/Log.h>
 
 #include "PEManager.h"
@@ -35,10 +37,19 @@ SyscallHandler SyscallHandler::_inst;
 
 #define SYS_ERROR(vpe, gate, error, msg) { \
         LOG(KERR, (vpe)->name() << ": " << msg << " (" << error << ")"); \
+        if(_cur) \
+            _cur->errors++; \
         reply_vmsg((gate), (error)); \
         return; \
     }
 
+#define SYS_FAIL(vpe, error, msg) { \
+        LOG(KERR, (vpe)->name() << ": " << msg << " (" << error << ")"); \
+        if(_cur) \
+            _cur->errors++; \
+        return (error); \
+    }
+
 struct ReplyInfo {
     explicit ReplyInfo(const DTU::Message &msg)
         : replylbl(msg.replylabel), replyep(msg.reply_epid()), crdep(msg.send_epid()),
@@ -52,11 +63,12 @@ struct ReplyInfo {
 };
 
 SyscallHandler::SyscallHandler()
-        : RequestHandler<SyscallHandler, Syscalls::Operation, Syscalls::COUNT>(),
+        : RequestHandler<SyscallHandler, Syscalls::Operation, Syscalls::COUNT>(), _workers(1),
           _rcvbuf(RecvBuf::create(epid(),
             nextlog2<AVAIL_PES>::val + KVPE::SYSC_CREDIT_ORD, KVPE::SYSC_CREDIT_ORD, 0)),
           _srvrcvbuf(RecvBuf::create(VPE::self().alloc_ep(),
-            nextlog2<1024>::val, nextlog2<256>::val, 0)) {
+            nextlog2<1024>::val, nextlog2<256>::val, 0)), _wrcvbufs(), _stats(), _cur() {
+    _wrcvbufs[0] = &_rcvbuf;
     // configure both receive buffers (we need to do that manually in the kernel)
     KDTU::get().config_recv_local(_rcvbuf.epid(), reinterpret_cast<uintptr_t>(_rcvbuf.addr()),
         _rcvbuf.order(), _rcvbuf.msgorder(), _rcvbuf.flags());
@@ -66,6 +78,7 @@ SyscallHandler::SyscallHandler()
     add_operation(Syscalls::CREATESRV, &SyscallHandler::createsrv);
     add_operation(Syscalls::CREATESESS, &SyscallHandler::createsess);
     add_operation(Syscalls::CREATEGATE, &SyscallHandler::creategate);
+    add_operation(Syscalls::CREATEMCAST, &SyscallHandler::createmcast);
     add_operation(Syscalls::CREATEVPE, &SyscallHandler::createvpe);
     add_operation(Syscalls::ATTACHRB, &SyscallHandler::attachrb);
     add_operation(Syscalls::DETACHRB, &SyscallHandler::detachrb);
@@ -79,11 +92,79 @@ SyscallHandler::SyscallHandler()
     add_operation(Syscalls::REVOKE, &SyscallHandler::revoke);
     add_operation(Syscalls::EXIT, &SyscallHandler::exit);
     add_operation(Syscalls::NOOP, &SyscallHandler::noop);
+    add_operation(Syscalls::BATCH, &SyscallHandler::batch);
+    add_operation(Syscalls::SYSCSTAT, &SyscallHandler::syscstat);
 #if defined(__host__)
     add_operation(Syscalls::INIT, &SyscallHandler::init);
 #endif
 }
 
+void SyscallHandler::set_workers(size_t workers) {
+    workers = Math::max<size_t>(1, Math::min(workers, MAX_WORKERS));
+    for(; _workers < workers; ++_workers) {
+        RecvBuf *rbuf = new RecvBuf(RecvBuf::create(VPE::self().alloc_ep(),
+            nextlog2<AVAIL_PES>::val + KVPE::SYSC_CREDIT_ORD, KVPE::SYSC_CREDIT_ORD, 0));
+        KDTU::get().config_recv_local(rbuf->epid(), reinterpret_cast<uintptr_t>(rbuf->addr()),
+            rbuf->order(), rbuf->msgorder(), rbuf->flags());
+        _wrcvbufs[_workers] = rbuf;
+    }
+}
+
+void SyscallHandler::handle_syscall(size_t worker, const DTU::Message *msg) {
+    RecvGate *gate = reinterpret_cast<RecvGate*>(msg->label);
+    Syscalls::Operation op = *reinterpret_cast<const Syscalls::Operation*>(msg->data);
+    if(static_cast<size_t>(op) >= Syscalls::COUNT) {
+        handle_message(*gate, nullptr);
+        return;
+    }
+
+    _cur = &_stats[worker][op];
+    cycles_t start = Profile::start();
+    handle_message(*gate, nullptr);
+    record(worker, op, Profile::stop() - start);
+    _cur = nullptr;
+}
+
+void SyscallHandler::stats(Syscalls::Operation op, Syscalls::Stat &stat) const {
+    stat = Syscalls::Stat();
+    for(size_t w = 0; w < _workers; ++w) {
+        const Syscalls::Stat &st = _stats[w][op];
+        stat.calls += __atomic_load_n(&st.calls, __ATOMIC_RELAXED);
+        stat.errors += __atomic_load_n(&st.errors, __ATOMIC_RELAXED);
+        stat.cycles += __atomic_load_n(&st.cycles, __ATOMIC_RELAXED);
+        for(size_t i = 0; i < Syscalls::STAT_BUCKETS; ++i)
+            stat.hist[i] += __atomic_load_n(&st.hist[i], __ATOMIC_RELAXED);
+    }
+}
+
+void SyscallHandler::dump_stats() const {
+    LOG(DEF, "Syscall statistics:");
+    for(size_t op = 0; op < Syscalls::COUNT; ++op) {
+        Syscalls::Stat st;
+        stats(static_cast<Syscalls::Operation>(op), st);
+        if(st.calls == 0)
+            continue;
+
+        LOG(DEF, "  " << fmt(Syscalls::to_string(static_cast<Syscalls::Operation>(op)), "-", 11)
+            << ": calls=" << st.calls << ", errors=" << st.errors
+            << ", avg=" << (st.cycles / st.calls) << " cycles");
+        for(size_t i = 0; i < Syscalls::STAT_BUCKETS; ++i) {
+            if(st.hist[i] > 0)
+                LOG(DEF, "    < 2^" << fmt(i + 1, 2) << ": " << st.hist[i]);
+        }
+    }
+
+    LOG(DEF, "Service queues:");
+    for(auto &s : ServiceList::get()) {
+        const KSendQueue::Stats &st = s.queue_stats();
+        LOG(DEF, "  " << fmt(s.name().c_str(), "-", 11)
+            << ": sent=" << st.sent << ", queued=" << st.queued << ", overflows=" << st.overflows
+            << ", maxdepth=" << st.max_depth
+            << ", avgwait=" << (st.queued ? st.wait / st.queued : 0) << " cycles"
+            << ", maxwait=" << st.max_wait << " cycles");
+    }
+}
+
 void SyscallHandler::createsrv(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_createsrv();
     KVPE *vpe = gate.session<KVPE>();
@@ -99,11 +180,17 @@ void SyscallHandler::createsrv(RecvGate &gate, GateIStream &is) {
     if(ServiceList::get().find(name) != nullptr)
         SYS_ERROR(vpe, gate, Errors::EXISTS, "Service does already exist");
 
+    // the credits of the gate determine how large the messages to the service can be
+    word_t credits = static_cast<MsgCapability*>(gatecap)->obj->credits;
+    if(credits <= DTU::HEADER_SIZE)
+        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Not enough credits for messages");
+    size_t msgsize = Math::min<size_t>(credits - DTU::HEADER_SIZE, KSendQueue::MAX_MSG_SIZE);
+
     capsel_t kcap = VPE::self().alloc_cap();
     CapTable::kernel_table().obtain(kcap, gatecap);
 
     int capacity = 1;   // TODO this depends on the credits that the kernel has
-    Service *s = ServiceList::get().add(*vpe, srv, name, kcap, capacity);
+    Service *s = ServiceList::get().add(*vpe, srv, name, kcap, msgsize, capacity);
     vpe->capabilities().set(srv, new ServiceCapability(s));
 
 #if defined(__host__)
@@ -112,8 +199,8 @@ void SyscallHandler::createsrv(RecvGate &gate, GateIStream &is) {
         int_target = vpe->pid();
 #endif
 
-    // maybe there are VPEs that now have all requirements fullfilled
-    PEManager::get().start_pending(ServiceList::get());
+    // maybe there are VPEs that now have all requirements fulfilled
+    PEManager::get().start_pending(name);
 
     reply_vmsg(gate, Errors::NO_ERROR);
 }
@@ -137,6 +224,12 @@ void SyscallHandler::createsess(RecvGate &gate, GateIStream &is) {
     if(!s || s->closing)
         SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Unknown service");
 
+    AutoGateOStream msg(vostreamsize(ostreamsize<server_type::Command>(), is.remaining()));
+    msg << server_type::OPEN;
+    msg.put(is);
+    if(msg.total() > s->msgsize())
+        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Arguments are too large for the service");
+
     ReplyInfo rinfo(is.message());
     Reference<Service> rsrv(s);
     vpe->service_gate().subscribe([this, rsrv, cap, vpe, rinfo]
@@ -170,16 +263,16 @@ void SyscallHandler::createsess(RecvGate &gate, GateIStream &is) {
         vpe->service_gate().unsubscribe(sub);
     });
 
-    AutoGateOStream msg(vostreamsize(ostreamsize<server_type::Command>(), is.remaining()));
-    msg << server_type::OPEN;
-    msg.put(is);
-    s->send(&vpe->service_gate(), msg.bytes(), msg.total());
+    s->send(vpe->id(), &vpe->service_gate(), msg.bytes(), msg.total());
     msg.claim();
 }
 
 void SyscallHandler::creategate(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_creategate();
-    KVPE *vpe = gate.session<KVPE>();
+    reply_vmsg(gate, do_creategate(gate.session<KVPE>(), is));
+}
+
+Errors::Code SyscallHandler::do_creategate(KVPE *vpe, GateIStream &is) {
     capsel_t tcap,dstcap;
     label_t label;
     size_t epid;
@@ -196,14 +289,47 @@ void SyscallHandler::creategate(RecvGate &gate, GateIStream &is) {
 
     VPECapability *tcapobj = static_cast<VPECapability*>(vpe->capabilities().get(tcap, Capability::VPE));
     if(tcapobj == nullptr)
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "VPE capability is invalid");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "VPE capability is invalid");
 
     // 0 points to the SEPs and can't be delegated to someone else
     if(epid == 0 || epid >= EP_COUNT || !vpe->capabilities().unused(dstcap))
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid cap or ep");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Invalid cap or ep");
 
     vpe->capabilities().set(dstcap, new MsgCapability(label, tcapobj->vpe->core(), epid, credits));
+    return Errors::NO_ERROR;
+}
+
+void SyscallHandler::createmcast(RecvGate &gate, GateIStream &is) {
+    KVPE *vpe = gate.session<KVPE>();
+    capsel_t dstcap;
+    size_t count;
+    is >> dstcap >> count;
+    LOG_SYS(vpe, "syscall::createmcast(cap=" << dstcap << ", members=" << count << ")");
+
+#if defined(__host__)
+    if(count == 0 || count > DTU::GROUP_MAX_MEMBERS || !vpe->capabilities().unused(dstcap))
+        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid cap or member count");
+
+    GroupObject *grp = new GroupObject(count);
+    for(size_t i = 0; i < count; ++i) {
+        capsel_t sel;
+        is >> sel;
+        MsgCapability *mcap = static_cast<MsgCapability*>(
+            vpe->capabilities().get(sel, Capability::MSG));
+        // the group doesn't have credits per member, so we can only allow unlimited ones
+        if(mcap == nullptr || mcap->type != Capability::MSG ||
+                mcap->obj->credits != static_cast<word_t>(-1)) {
+            delete grp;
+            SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid member cap " << sel);
+        }
+        grp->members[i] = mcap->obj;
+    }
+
+    vpe->capabilities().set(dstcap, new GroupCapability(grp));
     reply_vmsg(gate, Errors::NO_ERROR);
+#else
+    SYS_ERROR(vpe, gate, Errors::NOT_SUP, "Multicast gates are not supported");
+#endif
 }
 
 void SyscallHandler::createvpe(RecvGate &gate, GateIStream &is) {
@@ -233,7 +359,10 @@ void SyscallHandler::createvpe(RecvGate &gate, GateIStream &is) {
 
 void SyscallHandler::attachrb(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_attachrb();
-    KVPE *vpe = gate.session<KVPE>();
+    reply_vmsg(gate, do_attachrb(gate.session<KVPE>(), is));
+}
+
+Errors::Code SyscallHandler::do_attachrb(KVPE *vpe, GateIStream &is) {
     capsel_t tcap;
     uintptr_t addr;
     size_t ep;
@@ -246,18 +375,21 @@ void SyscallHandler::attachrb(RecvGate &gate, GateIStream &is) {
 
     VPECapability *tcapobj = static_cast<VPECapability*>(vpe->capabilities().get(tcap, Capability::VPE));
     if(tcapobj == nullptr)
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "VPE capability is invalid");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "VPE capability is invalid");
 
     Errors::Code res = RecvBufs::attach(tcapobj->vpe->core(), ep, addr, order, msgorder, flags);
     if(res != Errors::NO_ERROR)
-        SYS_ERROR(vpe, gate, res, "Unable to attach receive buffer");
+        SYS_FAIL(vpe, res, "Unable to attach receive buffer");
 
-    reply_vmsg(gate, Errors::NO_ERROR);
+    return Errors::NO_ERROR;
 }
 
 void SyscallHandler::detachrb(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_detachrb();
-    KVPE *vpe = gate.session<KVPE>();
+    reply_vmsg(gate, do_detachrb(gate.session<KVPE>(), is));
+}
+
+Errors::Code SyscallHandler::do_detachrb(KVPE *vpe, GateIStream &is) {
     capsel_t tcap;
     size_t ep;
     is >> tcap >> ep;
@@ -265,15 +397,18 @@ void SyscallHandler::detachrb(RecvGate &gate, GateIStream &is) {
 
     VPECapability *tcapobj = static_cast<VPECapability*>(vpe->capabilities().get(tcap, Capability::VPE));
     if(tcapobj == nullptr)
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "VPE capability is invalid");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "VPE capability is invalid");
 
     RecvBufs::detach(tcapobj->vpe->core(), ep);
-    reply_vmsg(gate, Errors::NO_ERROR);
+    return Errors::NO_ERROR;
 }
 
 void SyscallHandler::exchange(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_exchange();
-    KVPE *vpe = gate.session<KVPE>();
+    reply_vmsg(gate, do_exchange(gate.session<KVPE>(), is));
+}
+
+Errors::Code SyscallHandler::do_exchange(KVPE *vpe, GateIStream &is) {
     capsel_t tcap;
     CapRngDesc own, other;
     bool obtain;
@@ -284,12 +419,12 @@ void SyscallHandler::exchange(RecvGate &gate, GateIStream &is) {
     VPECapability *vpecap = static_cast<VPECapability*>(
             vpe->capabilities().get(tcap, Capability::VPE));
     if(vpecap == nullptr)
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid VPE cap");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Invalid VPE cap");
 
     KVPE *t1 = obtain ? vpecap->vpe : vpe;
     KVPE *t2 = obtain ? vpe : vpecap->vpe;
     Errors::Code res = do_exchange(t1, t2, own, other, obtain);
-    reply_vmsg(gate, res);
+    return res;
 }
 
 void SyscallHandler::vpectrl(RecvGate &gate, GateIStream &is) {
@@ -308,10 +443,18 @@ void SyscallHandler::vpectrl(RecvGate &gate, GateIStream &is) {
         SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid cap");
 
     switch(op) {
-        case Syscalls::VCTRL_START:
+        case Syscalls::VCTRL_START: {
             vpecap->vpe->start(0, nullptr, pid);
+#if defined(__host__)
+            // the parent passes the parameters on to the new process
+            Config::Params p;
+            vpecap->vpe->params(p);
+            reply_vmsg(gate, Errors::NO_ERROR, p.core, p.sysc_label, p.sysc_epid, p.sysc_credits);
+#else
             reply_vmsg(gate, Errors::NO_ERROR);
+#endif
             break;
+        }
 
         case Syscalls::VCTRL_WAIT:
             if(vpecap->vpe->state() == KVPE::DEAD)
@@ -330,7 +473,10 @@ void SyscallHandler::vpectrl(RecvGate &gate, GateIStream &is) {
 
 void SyscallHandler::reqmem(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_reqmem();
-    KVPE *vpe = gate.session<KVPE>();
+    reply_vmsg(gate, do_reqmem(gate.session<KVPE>(), is));
+}
+
+Errors::Code SyscallHandler::do_reqmem(KVPE *vpe, GateIStream &is) {
     capsel_t cap;
     uintptr_t addr;
     size_t size;
@@ -341,18 +487,18 @@ void SyscallHandler::reqmem(RecvGate &gate, GateIStream &is) {
         << ", perms=" << perms << ")");
 
     if(!vpe->capabilities().unused(cap))
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid cap");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Invalid cap");
     if(size == 0 || (size & MemGate::RWX) || perms == 0 || (perms & ~(MemGate::RWX)))
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Size or permissions invalid");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Size or permissions invalid");
 
     MainMemory &mem = MainMemory::get();
     if(addr != (uintptr_t)-1 && Math::overlap(addr, size, mem.addr(), mem.size()))
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Addr+size overlap with allocatable memory");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Addr+size overlap with allocatable memory");
 
     if(addr == (uintptr_t)-1) {
         addr = mem.map().allocate(size);
         if(addr == (uintptr_t)-1)
-            SYS_ERROR(vpe, gate, Errors::OUT_OF_MEM, "Not enough memory");
+            SYS_FAIL(vpe, Errors::OUT_OF_MEM, "Not enough memory");
     }
     else
         addr += mem.base();
@@ -361,12 +507,15 @@ void SyscallHandler::reqmem(RecvGate &gate, GateIStream &is) {
 
     // TODO if addr was 0, we don't want to free it on revoke
     vpe->capabilities().set(cap, new MemCapability(addr, size, perms, MEMORY_CORE, mem.epid()));
-    reply_vmsg(gate, Errors::NO_ERROR);
+    return Errors::NO_ERROR;
 }
 
 void SyscallHandler::derivemem(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_derivemem();
-    KVPE *vpe = gate.session<KVPE>();
+    reply_vmsg(gate, do_derivemem(gate.session<KVPE>(), is));
+}
+
+Errors::Code SyscallHandler::do_derivemem(KVPE *vpe, GateIStream &is) {
     capsel_t src, dst;
     size_t offset, size;
     int perms;
@@ -377,11 +526,11 @@ void SyscallHandler::derivemem(RecvGate &gate, GateIStream &is) {
     MemCapability *srccap = static_cast<MemCapability*>(
             vpe->capabilities().get(src, Capability::MEM));
     if(srccap == nullptr || !vpe->capabilities().unused(dst))
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid cap(s)");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Invalid cap(s)");
 
     if(offset + size < offset || offset + size > srccap->obj->credits || size == 0 ||
             (perms & ~(MemGate::RWX)))
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid args");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Invalid args");
 
     MemCapability *dercap = static_cast<MemCapability*>(vpe->capabilities().obtain(dst, srccap));
     dercap->obj = Reference<MsgObject>(new MemObject(
@@ -392,7 +541,7 @@ void SyscallHandler::derivemem(RecvGate &gate, GateIStream &is) {
         srccap->obj->epid
     ));
     dercap->obj->derived = true;
-    reply_vmsg(gate, Errors::NO_ERROR);
+    return Errors::NO_ERROR;
 }
 
 void SyscallHandler::delegate(RecvGate &gate, GateIStream &is) {
@@ -446,6 +595,12 @@ void SyscallHandler::exchange_over_sess(RecvGate &gate, GateIStream &is, bool ob
     if(sess->obj->srv->closing)
         SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Server is shutting down");
 
+    AutoGateOStream msg(vostreamsize(ostreamsize<server_type::Command, word_t, CapRngDesc>(), is.remaining()));
+    msg << (obtain ? server_type::OBTAIN : server_type::DELEGATE) << sess->obj->ident << caps.count();
+    msg.put(is);
+    if(msg.total() > sess->obj->srv->msgsize())
+        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Arguments are too large for the service");
+
     ReplyInfo rinfo(is.message());
     // only pass in the service-reference. we can't be sure that the session will still exist
     // when we receive the reply
@@ -485,10 +640,7 @@ void SyscallHandler::exchange_over_sess(RecvGate &gate, GateIStream &is, bool ob
         vpe->service_gate().unsubscribe(sub);
     });
 
-    AutoGateOStream msg(vostreamsize(ostreamsize<server_type::Command, word_t, CapRngDesc>(), is.remaining()));
-    msg << (obtain ? server_type::OBTAIN : server_type::DELEGATE) << sess->obj->ident << caps.count();
-    msg.put(is);
-    sess->obj->srv->send(&vpe->service_gate(), msg.bytes(), msg.total());
+    sess->obj->srv->send(vpe->id(), &vpe->service_gate(), msg.bytes(), msg.total());
     msg.claim();
 }
 
@@ -562,19 +714,31 @@ void SyscallHandler::activate(RecvGate &gate, GateIStream &is) {
 
 void SyscallHandler::revoke(RecvGate &gate, GateIStream &is) {
     EVENT_TRACER_Syscall_revoke();
-    KVPE *vpe = gate.session<KVPE>();
+    size_t count = 0;
+    Errors::Code res = do_revoke(gate.session<KVPE>(), is, &count);
+    if(res != Errors::NO_ERROR)
+        reply_vmsg(gate, res);
+    else
+        reply_vmsg(gate, Errors::NO_ERROR, count);
+}
+
+Errors::Code SyscallHandler::do_revoke(KVPE *vpe, GateIStream &is, size_t *removed) {
     CapRngDesc crd;
     is >> crd;
     LOG_SYS(vpe, "syscall::revoke(" << crd.start() << ":" << crd.count() << ")");
 
     if(crd.start() < 2)
-        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Cap 0 and 1 are not revokeable");
+        SYS_FAIL(vpe, Errors::INV_ARGS, "Cap 0 and 1 are not revokeable");
 
-    Errors::Code res = vpe->capabilities().revoke(crd);
+    size_t count = 0;
+    Errors::Code res = vpe->capabilities().revoke(crd, &count);
+    LOG_SYS(vpe, "syscall::revoke(" << crd.start() << ":" << crd.count() << ") removed " << count << " caps");
     if(res != Errors::NO_ERROR)
-        SYS_ERROR(vpe, gate, res, "Revoke failed");
+        SYS_FAIL(vpe, res, "Revoke failed");
 
-    reply_vmsg(gate, Errors::NO_ERROR);
+    if(removed)
+        *removed = count;
+    return Errors::NO_ERROR;
 }
 
 void SyscallHandler::exit(RecvGate &gate, GateIStream &is) {
@@ -591,7 +755,8 @@ void SyscallHandler::exit(RecvGate &gate, GateIStream &is) {
     if(PEManager::get().used() == 0) {
         PEManager::destroy();
         // ensure that the workloop stops
-        _rcvbuf.detach();
+        for(size_t i = 0; i < _workers; ++i)
+            _wrcvbufs[i]->detach();
         _srvrcvbuf.detach();
     }
     // if there are only daemons left, start the shutdown-procedure
@@ -603,6 +768,91 @@ void SyscallHandler::noop(RecvGate &gate, GateIStream &) {
     reply_vmsg(gate, 0);
 }
 
+void SyscallHandler::syscstat(RecvGate &gate, GateIStream &is) {
+    KVPE *vpe = gate.session<KVPE>();
+    Syscalls::Operation op;
+    size_t first;
+    is >> op >> first;
+    LOG_SYS(vpe, "syscall::syscstat(op=" << Syscalls::to_string(op) << ", first=" << first << ")");
+
+    if(static_cast<size_t>(op) >= Syscalls::COUNT ||
+            first > Syscalls::STAT_BUCKETS - Syscalls::STAT_BUCKETS_PER_MSG ||
+            (first % Syscalls::STAT_BUCKETS_PER_MSG) != 0)
+        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "Invalid operation or bucket");
+
+    // the first request takes a snapshot and the following ones return the rest of it. this way,
+    // the histogram matches the counters, even if other VPEs do syscalls in between
+    KVPE::StatSnapshot *snap = vpe->stat_snapshot();
+    if(first == 0) {
+        snap = new KVPE::StatSnapshot();
+        snap->op = op;
+        stats(op, snap->stat);
+        vpe->stat_snapshot(snap);
+    }
+    else if(snap == nullptr || snap->op != op)
+        SYS_ERROR(vpe, gate, Errors::INV_ARGS, "No snapshot of the statistics");
+
+    const Syscalls::Stat &st = snap->stat;
+    static_assert(Syscalls::STAT_BUCKETS_PER_MSG == 4, "Reply does not match");
+    reply_vmsg(gate, Errors::NO_ERROR, st.calls, st.errors, st.cycles,
+        st.hist[first + 0], st.hist[first + 1], st.hist[first + 2], st.hist[first + 3]);
+
+    if(first + Syscalls::STAT_BUCKETS_PER_MSG == Syscalls::STAT_BUCKETS)
+        vpe->stat_snapshot(nullptr);
+}
+
+Errors::Code SyscallHandler::do_batched(KVPE *vpe, Syscalls::Operation op, GateIStream &is) {
+    switch(op) {
+        case Syscalls::CREATEGATE:
+            return do_creategate(vpe, is);
+        case Syscalls::ATTACHRB:
+            return do_attachrb(vpe, is);
+        case Syscalls::DETACHRB:
+            return do_detachrb(vpe, is);
+        case Syscalls::EXCHANGE:
+            return do_exchange(vpe, is);
+        case Syscalls::REQMEM:
+            return do_reqmem(vpe, is);
+        case Syscalls::DERIVEMEM:
+            return do_derivemem(vpe, is);
+        case Syscalls::REVOKE:
+            return do_revoke(vpe, is);
+        case Syscalls::NOOP:
+            return Errors::NO_ERROR;
+        default:
+            // everything else might have to wait for someone else or does not reply at all
+            SYS_FAIL(vpe, Errors::NOT_SUP, "Syscall " << op << " can't be batched");
+    }
+}
+
+void SyscallHandler::batch(RecvGate &gate, GateIStream &is) {
+    KVPE *vpe = gate.session<KVPE>();
+    size_t count;
+    is >> count;
+    LOG_SYS(vpe, "syscall::batch(count=" << count << ")");
+
+    // execute them in order and stop at the first failure. the client knows the result of every
+    // operation by the number of executed ones, because all but the last one succeeded
+    Errors::Code res = Errors::NO_ERROR;
+    size_t done = 0;
+    while(done < count && res == Errors::NO_ERROR) {
+        // the client reads the number of executed operations in any case
+        if(is.remaining() < ostreamsize<Syscalls::Operation>()) {
+            LOG(KERR, vpe->name() << ": Batch is truncated (" << Errors::INV_ARGS << ")");
+            if(_cur)
+                _cur->errors++;
+            res = Errors::INV_ARGS;
+            break;
+        }
+
+        Syscalls::Operation op;
+        is >> op;
+        res = do_batched(vpe, op, is);
+        done++;
+    }
+    reply_vmsg(gate, res, done);
+}
+
 #if defined(__host__)
 void SyscallHandler::init(RecvGate &gate,GateIStream &is) {
     KVPE *vpe = gate.session<KVPE>();
@@ -32,14 +32,38 @@ class SyscallHandler : public RequestHandler<SyscallHandler, Syscalls::Operation
 public:
     using server_type = Server<SyscallHandler>;
 
+#if defined(__host__)
+    static constexpr size_t MAX_WORKERS = 4;
+#else
+    static constexpr size_t MAX_WORKERS = 1;
+#endif
+
     static SyscallHandler &get() {
         return _inst;
     }
 
+    /**
+     * Sets the number of syscall workers. Each worker has its own receive buffer, which is used for
+     * the syscalls of every <workers>'th VPE. Worker 0 is the kernel's work-loop itself. Has to be
+     * called before the first VPE is created.
+     *
+     * @param workers the number of workers (1..MAX_WORKERS)
+     */
+    void set_workers(size_t workers);
+    size_t workers() const {
+        return _workers;
+    }
+
     size_t epid() const {
         // we can use it here because we won't issue syscalls ourself
         return DTU::SYSC_EP;
     }
+    size_t epid(size_t worker) const {
+        return _wrcvbufs[worker]->epid();
+    }
+    size_t epid_of(const KVPE *vpe) const {
+        return epid(worker_of(vpe));
+    }
     size_t srvepid() const {
         return _srvrcvbuf.epid();
     }
@@ -50,10 +74,39 @@ public:
         return &_srvrcvbuf;
     }
 
+    /**
+     * Handles the syscall <msg> that has been received by worker <worker> and records its duration.
+     * Has to be called with the kernel lock held.
+     */
+    void handle_syscall(size_t worker, const DTU::Message *msg);
+    /**
+     * Records that worker <worker> handled the syscall <op> in <cycles> cycles. Since each worker
+     * has its own statistics and the counters are updated atomically, this can be used without
+     * the kernel lock.
+     */
+    void record(size_t worker, Syscalls::Operation op, cycles_t cycles) {
+        Syscalls::Stat &st = _stats[worker][op];
+        size_t bucket = cycles == 0 ? 0 : sizeof(cycles_t) * 8 - 1 - __builtin_clzll(cycles);
+        __atomic_fetch_add(&st.calls, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&st.cycles, cycles, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&st.hist[Math::min(bucket, Syscalls::STAT_BUCKETS - 1)], 1,
+            __ATOMIC_RELAXED);
+    }
+    /**
+     * Collects the statistics of all workers for syscall <op> into <stat>. Each counter is read
+     * atomically, but the NOOPs that are recorded without the kernel lock meanwhile might be
+     * contained in some counters and not yet in others.
+     */
+    void stats(Syscalls::Operation op, Syscalls::Stat &stat) const;
+    /**
+     * Prints the statistics of all syscalls that have been used.
+     */
+    void dump_stats() const;
+
     RecvGate create_gate(KVPE *vpe) {
         using std::placeholders::_1;
         using std::placeholders::_2;
-        RecvGate syscc = RecvGate::create(&_rcvbuf, vpe);
+        RecvGate syscc = RecvGate::create(_wrcvbufs[worker_of(vpe)], vpe);
         add_session(vpe);
         return syscc;
     }
@@ -61,6 +114,7 @@ public:
     void createsrv(RecvGate &gate, GateIStream &is);
     void createsess(RecvGate &gate, GateIStream &is);
     void creategate(RecvGate &gate, GateIStream &is);
+    void createmcast(RecvGate &gate, GateIStream &is);
     void createvpe(RecvGate &gate, GateIStream &is);
     void attachrb(RecvGate &gate, GateIStream &is);
     void detachrb(RecvGate &gate, GateIStream &is);
@@ -74,17 +128,36 @@ public:
     void revoke(RecvGate &gate, GateIStream &is);
     void exit(RecvGate &gate, GateIStream &is);
     void noop(RecvGate &gate, GateIStream &is);
+    void batch(RecvGate &gate, GateIStream &is);
+    void syscstat(RecvGate &gate, GateIStream &is);
 
 #if defined(__host__)
     void init(m3::RecvGate &gate, m3::GateIStream &is);
 #endif
 
 private:
+    size_t worker_of(const KVPE *vpe) const {
+        return vpe->id() % _workers;
+    }
+
+    Errors::Code do_creategate(KVPE *vpe, GateIStream &is);
+    Errors::Code do_attachrb(KVPE *vpe, GateIStream &is);
+    Errors::Code do_detachrb(KVPE *vpe, GateIStream &is);
+    Errors::Code do_exchange(KVPE *vpe, GateIStream &is);
+    Errors::Code do_reqmem(KVPE *vpe, GateIStream &is);
+    Errors::Code do_derivemem(KVPE *vpe, GateIStream &is);
+    Errors::Code do_revoke(KVPE *vpe, GateIStream &is, size_t *removed = nullptr);
+    Errors::Code do_batched(KVPE *vpe, Syscalls::Operation op, GateIStream &is);
     Errors::Code do_exchange(KVPE *v1, KVPE *v2, const CapRngDesc &c1, const CapRngDesc &c2, bool obtain);
     void exchange_over_sess(RecvGate &gate, GateIStream &is, bool obtain);
 
+    size_t _workers;
     RecvBuf _rcvbuf;
     RecvBuf _srvrcvbuf;
+    RecvBuf *_wrcvbufs[MAX_WORKERS];
+    Syscalls::Stat _stats[MAX_WORKERS][Syscalls::COUNT];
+    // the statistics of the syscall that is currently handled, if any
+    Syscalls::Stat *_cur;
     static SyscallHandler _inst;
 };
 
@@ -79,6 +79,7 @@ KVPE::~KVPE() {
     SyscallHandler::get().remove_session(this);
     detach_rbufs();
     free_reqs();
+    stat_snapshot(nullptr);
 }
 
 }
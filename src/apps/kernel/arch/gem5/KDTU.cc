@@ -56,6 +56,16 @@ void KDTU::invalidate_eps(int core) {
     delete[] eps;
 }
 
+void KDTU::invalidate_eps(int core, int first, int count) {
+    DTU::EpRegs *eps = new DTU::EpRegs[count];
+    size_t total = sizeof(*eps) * count;
+    memset(eps, 0, total);
+    Sync::compiler_barrier();
+    uintptr_t dst = reinterpret_cast<uintptr_t>(DTU::ep_regs(first));
+    write_mem(core, dst, eps, total);
+    delete[] eps;
+}
+
 void KDTU::config_recv(void *e, uintptr_t buf, uint order, uint msgorder, int) {
     DTU::EpRegs *ep = reinterpret_cast<DTU::EpRegs*>(e);
     ep->bufAddr = buf;
@@ -26,11 +26,15 @@ void KDTU::deprivilege(int) {
 }
 
 void KDTU::invalidate_eps(int core) {
-    size_t total = DTU::EPS_RCNT * EP_COUNT;
+    invalidate_eps(core, 0, EP_COUNT);
+}
+
+void KDTU::invalidate_eps(int core, int first, int count) {
+    size_t total = DTU::EPS_RCNT * count;
     word_t *regs = new word_t[total];
-    memset(regs, 0, total);
+    memset(regs, 0, total * sizeof(word_t));
     PEManager::get().vpe(core - APP_CORES).seps_gate().write_sync(
-        regs, total * sizeof(word_t), 0);
+        regs, total * sizeof(word_t), first * DTU::EPS_RCNT * sizeof(word_t));
     delete[] regs;
 }
 
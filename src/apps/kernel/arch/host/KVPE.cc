@@ -21,8 +21,9 @@
 #include "../../KVPE.h"
 
 #include <unistd.h>
-#include <fstream>
+#include <fcntl.h>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <cerrno>
 
@@ -33,11 +34,24 @@ void KVPE::start(int argc, char **argv, int pid) {
     ref();
     _state = RUNNING;
     if(pid == 0) {
+        // pass the parameters via a pipe. they fit into it, so that we can write them upfront
+        Config::Params p;
+        params(p);
+        int fds[2];
+        if(pipe2(fds, O_CLOEXEC) == -1 || write(fds[1], &p, sizeof(p)) != sizeof(p))
+            PANIC("Unable to pass parameters to VPE: " << strerror(errno));
+        close(fds[1]);
+
         _pid = fork();
         if(_pid < 0)
             PANIC("fork");
         if(_pid == 0) {
-            write_env_file(getpid(), _syscgate.label(), SyscallHandler::get().epid());
+            // the pipe has to survive the exec
+            char fdstr[16];
+            fcntl(fds[0], F_SETFD, 0);
+            snprintf(fdstr, sizeof(fdstr), "%d", fds[0]);
+            setenv("M3_ENV_FD", fdstr, 1);
+
             char **childargs = new char*[argc + 1];
             int i = 0, j = 0;
             for(; i < argc; ++i) {
@@ -56,10 +70,11 @@ void KVPE::start(int argc, char **argv, int pid) {
         }
         else
             LOG(VPES, "Started VPE '" << _name << "' [pid=" << _pid << "]");
+        close(fds[0]);
     }
     else {
+        // the parent receives the parameters as reply and passes them on
         _pid = pid;
-        write_env_file(_pid, _syscgate.label(), SyscallHandler::get().epid());
         LOG(VPES, "Started VPE '" << _name << "' [pid=" << _pid << "]");
     }
 }
@@ -70,7 +85,7 @@ void KVPE::activate_sysc_ep(void *addr) {
     MemCapability *mcap = static_cast<MemCapability*>(
         CapTable::kernel_table().get(_sepsgate.sel(), Capability::MEM));
     if(mcap == nullptr) {
-        size_t len = DTU::EPS_RCNT * EP_COUNT * sizeof(word_t);
+        size_t len = DTU::ALL_EPS_RCNT * sizeof(word_t);
         mcap = new MemCapability(iaddr, len, MemGate::X | MemGate::W, core(), 0);
         CapTable::kernel_table().set(_sepsgate.sel(), mcap);
     }
@@ -78,15 +93,15 @@ void KVPE::activate_sysc_ep(void *addr) {
         mcap->obj->label = iaddr | MemGate::X | MemGate::W;
 }
 
-void KVPE::write_env_file(pid_t pid, label_t label, size_t epid) {
-    char tmpfile[64];
-    snprintf(tmpfile, sizeof(tmpfile), "/tmp/m3/%d", pid);
-    std::ofstream of(tmpfile);
-    of << Config::get().shm_prefix().c_str() << "\n";
-    of << core() << "\n";
-    of << label << "\n";
-    of << epid << "\n";
-    of << (1 << SYSC_CREDIT_ORD) << "\n";
+void KVPE::params(Config::Params &p) {
+    strncpy(p.shm_prefix, Config::get().shm_prefix().c_str(), sizeof(p.shm_prefix));
+    p.shm_prefix[sizeof(p.shm_prefix) - 1] = '\0';
+    p.core = core();
+    p.sysc_label = _syscgate.label();
+    p.sysc_epid = SyscallHandler::get().epid_of(this);
+    p.sysc_credits = 1 << SYSC_CREDIT_ORD;
+    p.dram_fd = MainMemory::get().fd();
+    p.dram_base = MainMemory::get().base();
 }
 
 Errors::Code KVPE::xchg_ep(size_t epid, MsgCapability *oldcapobj, MsgCapability *newcapobj) {
@@ -95,12 +110,29 @@ Errors::Code KVPE::xchg_ep(size_t epid, MsgCapability *oldcapobj, MsgCapability
     memset(regs, 0, sizeof(regs));
     MsgCapability *co[] = {oldcapobj, newcapobj};
     for(size_t i = 0; i < 2; ++i) {
-        if(co[i]) {
+        if(co[i] && (co[i]->type & Capability::GROUP)) {
+            DTU::get().configure(regs, i, 0, DTU::MULTICAST_CORE, co[i]->obj->epid,
+                co[i]->obj->credits);
+        }
+        else if(co[i]) {
             DTU::get().configure(regs, i, co[i]->obj->label, co[i]->obj->core,
                 co[i]->obj->epid, co[i]->obj->credits);
         }
     }
 
+    // the members of a multicast gate have to be in place before the endpoint is switched to it
+    if(newcapobj && (newcapobj->type & Capability::GROUP)) {
+        const GroupObject *grp = static_cast<GroupCapability*>(newcapobj)->group();
+        word_t grpregs[DTU::GROUPS_RCNT];
+        memset(grpregs, 0, sizeof(grpregs));
+        for(size_t i = 0; i < grp->count(); ++i) {
+            const MsgObject *m = grp->members[i].get();
+            DTU::configure_group(grpregs, i, m->label, m->core, m->epid);
+        }
+        seps_gate().write_sync(grpregs, sizeof(grpregs),
+            (DTU::GROUPS_START + epid * DTU::GROUPS_RCNT) * sizeof(word_t));
+    }
+
     if(newcapobj) {
         // now do the compare-exchange
         if(!seps_gate().cmpxchg_sync(regs, sizeof(regs), epid * DTU::EPS_RCNT * sizeof(word_t)))
@@ -119,6 +151,7 @@ KVPE::~KVPE() {
     SyscallHandler::get().remove_session(this);
     detach_rbufs();
     free_reqs();
+    stat_snapshot(nullptr);
 
     // revoke all caps first because we might need the sepsgate for that
     _caps.revoke_all();
@@ -21,6 +21,7 @@
 #include <m3/RecvBuf.h>
 #include <m3/Log.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include "../../MemoryMap.h"
 #include "../../KDTU.h"
@@ -28,8 +29,10 @@
 namespace m3 {
 
 class MainMemory {
+    // the memfd is inherited by all VPEs, which map it as well to let their DTU access it directly
     explicit MainMemory()
-            : _addr(mmap(0, DRAM_SIZE, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0)),
+            : _fd(memfd_create("m3-dram", 0)),
+              _addr(mmap(0, DRAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, init_fd(_fd), 0)),
               _size(DRAM_SIZE), _map(addr(), DRAM_SIZE),
               _rbuf(RecvBuf::create(VPE::self().alloc_ep(), 0,
                       RecvBuf::NO_HEADER | RecvBuf::NO_RINGBUF)) {
@@ -40,9 +43,18 @@ class MainMemory {
 
         if(_addr == MAP_FAILED)
             PANIC("mmap failed: " << strerror(errno));
+        DTU::get().set_dram(addr(), _addr, _size);
         LOG(DEF, "Mapped " << (DRAM_SIZE / 1024 / 1024) << " MiB of main memory @ " << _addr);
     }
 
+    static int init_fd(int fd) {
+        if(fd == -1)
+            PANIC("memfd_create failed: " << strerror(errno));
+        if(ftruncate(fd, DRAM_SIZE) == -1)
+            PANIC("ftruncate failed: " << strerror(errno));
+        return fd;
+    }
+
 public:
     static MainMemory &get() {
         return _inst;
@@ -60,11 +72,15 @@ public:
     size_t epid() const {
         return _rbuf.epid();
     }
+    int fd() const {
+        return _fd;
+    }
     MemoryMap &map() {
         return _map;
     }
 
 private:
+    int _fd;
     void *_addr;
     size_t _size;
     MemoryMap _map;
@@ -26,7 +26,6 @@
 #include <cstdio>
 #include <cstdlib>
 #include <fcntl.h>
-#include <dirent.h>
 
 #include "../../KWorkLoop.h"
 #include "../../Services.h"
@@ -61,20 +60,6 @@ static void sigint(int) {
     WorkLoop::get().stop();
 }
 
-static void delete_dir(const char *dir) {
-    char path[64];
-    DIR *d = opendir(dir);
-    struct dirent *e;
-    while((e = readdir(d))) {
-        if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
-            continue;
-        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
-        unlink(path);
-    }
-    closedir(d);
-    rmdir(dir);
-}
-
 static void copyfromfs(MainMemory &mem, const char *file) {
     int fd = open(file, O_RDONLY);
     if(fd < 0)
@@ -109,7 +94,8 @@ int __default_conf = 0;
 
 int main(int argc, char *argv[]) {
     const char *fsimg = nullptr;
-    mkdir("/tmp/m3", 0755);
+    size_t budget = KWorkLoop::DEF_BUDGET;
+    size_t workers = 1;
     KernelEPSwitcher *epsw = new KernelEPSwitcher();
     EPMux::get().set_epswitcher(epsw);
     signal(SIGINT, sigint);
@@ -121,6 +107,10 @@ int main(int argc, char *argv[]) {
             devices.append(new TimerDevice());
         else if(strncmp(argv[i], "fs=", 3) == 0)
             fsimg = argv[i] + 3;
+        else if(strncmp(argv[i], "budget=", 7) == 0)
+            budget = strtoul(argv[i] + 7, nullptr, 0);
+        else if(strncmp(argv[i], "workers=", 8) == 0)
+            workers = strtoul(argv[i] + 8, nullptr, 0);
     }
 
     int argstart = 0;
@@ -133,9 +123,10 @@ int main(int argc, char *argv[]) {
 
     if(fsimg)
         copyfromfs(MainMemory::get(), fsimg);
+    SyscallHandler::get().set_workers(workers);
     LOG(DEF, "Initializing PEs.");
     PEManager::create(argc - argstart - 1, argv + argstart + 1);
-    KWorkLoop::run();
+    KWorkLoop::run(budget);
 
     LOG(DEF, "Shutting down.");
     if(fsimg)
@@ -147,6 +138,5 @@ int main(int argc, char *argv[]) {
         delete &*old;
     }
     delete epsw;
-    delete_dir("/tmp/m3");
     return EXIT_SUCCESS;
 }
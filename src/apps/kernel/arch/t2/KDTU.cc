@@ -49,6 +49,14 @@ void KDTU::invalidate_eps(int core) {
     write_mem(core, CONF_GLOBAL, &conf, sizeof(conf));
 }
 
+void KDTU::invalidate_eps(int core, int first, int count) {
+    alignas(DTU_PKG_SIZE) EPConf conf[EP_COUNT];
+    memset(conf, 0, sizeof(conf[0]) * count);
+    Sync::memory_barrier();
+    uintptr_t addr = CONF_GLOBAL + offsetof(CoreConf, eps) + first * sizeof(EPConf);
+    write_mem(core, addr, conf, sizeof(conf[0]) * count);
+}
+
 void KDTU::config_recv_local(int, uintptr_t, uint, uint, int) {
     // nothing to do; everything is always ready and fixed on T2 for receiving
 }
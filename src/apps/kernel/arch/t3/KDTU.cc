@@ -44,7 +44,12 @@ void KDTU::invalidate_ep(int core, int ep) {
 }
 
 void KDTU::invalidate_eps(int core) {
-    for(int i = 0; i < EP_COUNT; ++i)
+    invalidate_eps(core, 0, EP_COUNT);
+}
+
+void KDTU::invalidate_eps(int core, int first, int count) {
+    // the external config registers of the endpoints are not contiguous
+    for(int i = first; i < first + count; ++i)
         invalidate_ep(core, i);
 }
 
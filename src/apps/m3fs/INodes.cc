@@ -23,6 +23,19 @@ using namespace m3;
 
 loclist_type INodes::_locs;
 
+static Errors::Code batch_derivemem(Syscalls::Batch &batch, capsel_t src, capsel_t dst,
+        size_t offset, size_t size, int perms) {
+    // if it doesn't fit anymore, execute the collected ones first
+    if(!batch.derivemem(src, dst, offset, size, perms)) {
+        Errors::Code res = Syscalls::get().batch(batch);
+        batch.clear();
+        if(res != Errors::NO_ERROR)
+            return res;
+        batch.derivemem(src, dst, offset, size, perms);
+    }
+    return Errors::NO_ERROR;
+}
+
 INode *INodes::create(FSHandle &h, mode_t mode) {
     inodeno_t ino = h.inodes().alloc(h);
     if(ino == 0) {
@@ -82,6 +95,8 @@ loclist_type *INodes::get_locs(FSHandle &h, INode *inode, size_t extent,
     }
 
     crd = CapRngDesc(VPE::self().alloc_caps(locs), locs);
+    // create all memory capabilities with as few syscalls as possible
+    Syscalls::Batch batch;
     Extent *indir = nullptr;
     // we're reusing the locations
     _locs.clear();
@@ -108,7 +123,7 @@ loclist_type *INodes::get_locs(FSHandle &h, INode *inode, size_t extent,
 
         // create memory capability for extent
         size_t bytes = ch->length * h.sb().blocksize;
-        Errors::Code res = Syscalls::get().derivemem(
+        Errors::Code res = batch_derivemem(batch,
             h.mem().sel(), crd.start() + _locs.count(), ch->start * h.sb().blocksize, bytes, perms);
         if(res != Errors::NO_ERROR) {
             crd.free_and_revoke();
@@ -127,6 +142,11 @@ loclist_type *INodes::get_locs(FSHandle &h, INode *inode, size_t extent,
         if(ch->length <= blocks)
             blocks -= ch->length;
     }
+
+    if(Syscalls::get().batch(batch) != Errors::NO_ERROR) {
+        crd.free_and_revoke();
+        return nullptr;
+    }
     return &_locs;
 }
 
@@ -50,8 +50,10 @@ int main(int argc, char **argv) {
     const size_t MEM_SIZE    = vpes * memPerVPE;
     const size_t SUBMEM_SIZE = MEM_SIZE / vpes;
 
+    // every worker sends one message, which might arrive at the same time
+    int msgord = getnextlog2(DTU_PKG_SIZE + DTU::HEADER_SIZE);
     RecvBuf rbuf = RecvBuf::create(VPE::self().alloc_ep(),
-        getnextlog2(vpes * (DTU_PKG_SIZE + DTU::HEADER_SIZE)), 0);
+        getnextlog2(vpes) + msgord, msgord, 0);
     RecvGate rgate = RecvGate::create(&rbuf);
 
     MemGate mem = MemGate::create_global(MEM_SIZE, MemGate::RW);
@@ -22,7 +22,6 @@
 #include <m3/Syscalls.h>
 #include <m3/GateStream.h>
 #include <m3/WorkLoop.h>
-#include <m3/SendQueue.h>
 #include <m3/Log.h>
 
 #include <unistd.h>
@@ -34,21 +33,12 @@ static Server<EventHandler> *server;
 
 static constexpr size_t DATA_SIZE   = 256;
 
-static char *gendata() {
-    char *data = new char[DATA_SIZE];
+static void timer_irq(RecvGate &, Subscriber<RecvGate&>*) {
+    static char data[DATA_SIZE];
     for(size_t i = 0; i < DATA_SIZE; ++i)
         data[i] = rand() % 256;
-    return data;
-}
-
-static void timer_irq(RecvGate &, Subscriber<RecvGate&>*) {
-    for(auto &h : server->handler()) {
-        // skip clients that have a session but no gate yet
-        if(h.gate()) {
-            SendQueue::get().send(*static_cast<SendGate*>(h.gate()), gendata(),
-                DATA_SIZE, SendQueue::array_deleter<char>);
-        }
-    }
+    // all clients get the same data; clients that have no gate yet are skipped
+    server->handler().broadcast_msg(data, DATA_SIZE);
 }
 
 int main() {
@@ -58,7 +48,6 @@ int main() {
     // now, register service
     server = new Server<EventHandler>("queuetest", new EventHandler(), nextlog2<4096>::val);
 
-    WorkLoop::get().add(&SendQueue::get(), true);
     WorkLoop::get().run();
     return 0;
 }
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <m3/Common.h>
+#include <m3/stream/Serial.h>
+#include <m3/Syscalls.h>
+#include <m3/Log.h>
+
+using namespace m3;
+
+static void print_hist(const Syscalls::Stat &st) {
+    word_t max = 0;
+    for(size_t i = 0; i < Syscalls::STAT_BUCKETS; ++i)
+        max = Math::max(max, st.hist[i]);
+
+    for(size_t i = 0; i < Syscalls::STAT_BUCKETS; ++i) {
+        if(st.hist[i] == 0)
+            continue;
+        Serial::get() << "    < 2^" << fmt(i + 1, 2) << ": " << fmt(st.hist[i], 8) << " ";
+        // scale the bars to at most 40 characters
+        for(word_t j = 0; j < (st.hist[i] * 40 + max - 1) / max; ++j)
+            Serial::get() << '#';
+        Serial::get() << '\n';
+    }
+}
+
+int main(int argc, char **argv) {
+    bool hist = argc > 1 && strcmp(argv[1], "-h") == 0;
+
+    Serial::get() << fmt("syscall", "-", 11) << fmt("calls", 10) << fmt("errors", 8)
+                  << fmt("avg cycles", 12) << "\n";
+    for(size_t op = 0; op < Syscalls::COUNT; ++op) {
+        Syscalls::Operation sop = static_cast<Syscalls::Operation>(op);
+        Syscalls::Stat st;
+        if(Syscalls::get().syscstat(sop, st) != Errors::NO_ERROR)
+            PANIC("Unable to get statistics for " << Syscalls::to_string(sop) << ": "
+                << Errors::to_string(Errors::last));
+        if(st.calls == 0)
+            continue;
+
+        Serial::get() << fmt(Syscalls::to_string(sop), "-", 11) << fmt(st.calls, 10)
+                      << fmt(st.errors, 8) << fmt(st.cycles / st.calls, 12) << "\n";
+        if(hist)
+            print_hist(st);
+    }
+    return 0;
+}
@@ -86,6 +86,22 @@ void CommandsTestSuite::ReadCmdTestCase::run() {
             assert_word(buf[i], data[i]);
     }
 
+    Serial::get() << "-- Test reading with IOVecs --\n";
+    {
+        dtu.configure(sndepid, reinterpret_cast<word_t>(data) | MemGate::R, coreid(),
+            rcvepid, datasize);
+
+        word_t buf1[1], buf2[3];
+        IOVec iov[] = {{buf1, sizeof(buf1)}, {buf2, sizeof(buf2)}};
+
+        dtu.readv(sndepid, iov, ARRAY_SIZE(iov), 0, datasize);
+        dtu.wait_until_ready(sndepid);
+        assert_true(dtu.wait_for_mem_cmd());
+        assert_word(buf1[0], data[0]);
+        for(size_t i = 0; i < 3; ++i)
+            assert_word(buf2[i], data[i + 1]);
+    }
+
     unmap_page(addr);
     dtu.configure(sndepid, 0, 0, 0, 0);
 }
@@ -126,6 +142,26 @@ void CommandsTestSuite::WriteCmdTestCase::run() {
         dtu.ack_message(rcvepid);
     }
 
+    Serial::get() << "-- Test writing with IOVecs --\n";
+    {
+        word_t data1[] = {4321, 8765};
+        word_t data2[] = {2211, 4433};
+        IOVec iov[] = {{data1, sizeof(data1)}, {data2, sizeof(data2)}};
+        dtu.configure(sndepid, reinterpret_cast<word_t>(addr) | MemGate::W, coreid(),
+            rcvepid, sizeof(data1) + sizeof(data2));
+
+        dtu.writev(sndepid, iov, ARRAY_SIZE(iov), 0, sizeof(data1) + sizeof(data2));
+        dtu.wait_until_ready(sndepid);
+        assert_false(dtu.get_cmd(DTU::CMD_CTRL) & DTU::CTRL_ERROR);
+        getmsg(rcvepid, 1);
+        word_t *words = reinterpret_cast<word_t*>(addr);
+        assert_word(words[0], data1[0]);
+        assert_word(words[1], data1[1]);
+        assert_word(words[2], data2[0]);
+        assert_word(words[3], data2[1]);
+        dtu.ack_message(rcvepid);
+    }
+
     unmap_page(addr);
     dtu.configure(sndepid, 0, 0, 0, 0);
 }
@@ -199,3 +235,71 @@ void CommandsTestSuite::CmpxchgCmdTestCase::run() {
     unmap_page(addr);
     dtu.configure(sndepid, 0, 0, 0, 0);
 }
+
+void CommandsTestSuite::AtomicCmdTestCase::run() {
+    const size_t rcvepid = 3;
+    const size_t sndepid = 4;
+    DTU &dtu = DTU::get();
+    RecvBuf buf = RecvBuf::create(sndepid, nextlog2<128>::val, nextlog2<64>::val, 0);
+    // only necessary to set the msgqid
+    RecvBuf rbuf = RecvBuf::create(rcvepid, nextlog2<1>::val, RecvBuf::NO_RINGBUF);
+
+    void *addr = map_page();
+    if(!addr)
+        return;
+
+    const size_t refdatasize = sizeof(word_t) * 2;
+    word_t *refdata = reinterpret_cast<word_t*>(addr);
+    refdata[0] = 0x10;
+    refdata[1] = 0xF0;
+
+    Serial::get() << "-- Test errors --\n";
+    {
+        word_t val = 1;
+        dtu.configure(sndepid, reinterpret_cast<word_t>(refdata) | MemGate::R, coreid(),
+            rcvepid, refdatasize);
+
+        dmacmd(&val, sizeof(val), sndepid, 0, sizeof(val), DTU::FETCH_ADD);
+        assert_true(dtu.get_cmd(DTU::CMD_CTRL) & DTU::CTRL_ERROR);
+
+        dtu.configure(sndepid, reinterpret_cast<word_t>(refdata) | MemGate::RW, coreid(),
+            rcvepid, refdatasize);
+
+        dmacmd(&val, sizeof(val), sndepid, 1, sizeof(val), DTU::FETCH_ADD);
+        assert_true(dtu.get_cmd(DTU::CMD_CTRL) & DTU::CTRL_ERROR);
+        assert_word(refdata[0], 0x10);
+    }
+
+    Serial::get() << "-- Test operations --\n";
+    {
+        dtu.configure(sndepid, reinterpret_cast<word_t>(refdata) | MemGate::RW, coreid(),
+            rcvepid, refdatasize);
+
+        word_t val = 5;
+        dmacmd(&val, sizeof(val), sndepid, 0, sizeof(val), DTU::FETCH_ADD);
+        assert_true(dtu.wait_for_mem_cmd());
+        assert_word(val, 0x10);
+        assert_word(refdata[0], 0x15);
+
+        val = 0x20;
+        dmacmd(&val, sizeof(val), sndepid, 0, sizeof(val), DTU::SWAP);
+        assert_true(dtu.wait_for_mem_cmd());
+        assert_word(val, 0x15);
+        assert_word(refdata[0], 0x20);
+
+        val = 0x0F;
+        dmacmd(&val, sizeof(val), sndepid, sizeof(word_t), sizeof(val), DTU::FETCH_OR);
+        assert_true(dtu.wait_for_mem_cmd());
+        assert_word(val, 0xF0);
+        assert_word(refdata[1], 0xFF);
+
+        val = 0x3C;
+        dmacmd(&val, sizeof(val), sndepid, sizeof(word_t), sizeof(val), DTU::FETCH_AND);
+        assert_true(dtu.wait_for_mem_cmd());
+        assert_word(val, 0xFF);
+        assert_word(refdata[1], 0x3C);
+    }
+
+    unmap_page(addr);
+    dtu.configure(sndepid, 0, 0, 0, 0);
+}
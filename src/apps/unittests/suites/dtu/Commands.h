@@ -42,11 +42,19 @@ private:
         virtual void run() override;
     };
 
+    class AtomicCmdTestCase : public BaseTestCase {
+    public:
+        explicit AtomicCmdTestCase() : BaseTestCase("Atomic commands") {
+        }
+        virtual void run() override;
+    };
+
 public:
     explicit CommandsTestSuite()
         : TestSuite("Commands") {
         add(new ReadCmdTestCase());
         add(new WriteCmdTestCase());
         add(new CmpxchgCmdTestCase());
+        add(new AtomicCmdTestCase());
     }
 };
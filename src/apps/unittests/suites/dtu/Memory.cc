@@ -16,6 +16,8 @@
 
 #include <m3/GateStream.h>
 #include <m3/Log.h>
+#include <sys/mman.h>
+
 #include "Memory.h"
 
 using namespace m3;
@@ -36,6 +38,125 @@ void MemoryTestSuite::SyncTestCase::run() {
     }
 }
 
+void MemoryTestSuite::VectorTestCase::run() {
+    static ulong head[1];
+    static ulong body[3];
+
+    MemGate gate = MemGate::bind(_mem.sel());
+
+    Serial::get() << "-- Test writev/readv --\n";
+    {
+        head[0] = 1;
+        body[0] = 2;
+        body[1] = 3;
+        body[2] = 4;
+        IOVec iov[] = {{head, sizeof(head)}, {body, sizeof(body)}};
+        gate.writev(iov, ARRAY_SIZE(iov), 0);
+
+        ulong data[4];
+        gate.read_sync(data, sizeof(data), 0);
+        for(size_t i = 0; i < ARRAY_SIZE(data); ++i)
+            assert_int(data[i], i + 1);
+
+        head[0] = body[0] = body[1] = body[2] = 0;
+        IOVec riov[] = {{body, sizeof(body)}, {head, sizeof(head)}};
+        gate.readv(riov, ARRAY_SIZE(riov), 0);
+        assert_int(body[0], 1);
+        assert_int(body[1], 2);
+        assert_int(body[2], 3);
+        assert_int(head[0], 4);
+    }
+}
+
+void MemoryTestSuite::AsyncTestCase::run() {
+    static ulong src[32];
+    static ulong dst[32];
+
+    MemGate gate = MemGate::bind(_mem.sel());
+
+    Serial::get() << "-- Test read/write async --\n";
+    {
+        // use more transfers than the DTU can queue at once
+        word_t tokens[ARRAY_SIZE(src)];
+        for(size_t i = 0; i < ARRAY_SIZE(src); ++i) {
+            src[i] = i + 1;
+            tokens[i] = gate.write_async(src + i, sizeof(ulong), i * sizeof(ulong));
+        }
+        for(size_t i = 0; i < ARRAY_SIZE(src); ++i)
+            assert_true(gate.wait(tokens[i]));
+
+        for(size_t i = 0; i < ARRAY_SIZE(dst); ++i)
+            tokens[i] = gate.read_async(dst + i, sizeof(ulong), i * sizeof(ulong));
+        for(size_t i = 0; i < ARRAY_SIZE(dst); ++i) {
+            assert_true(gate.wait(tokens[i]));
+            assert_int(dst[i], i + 1);
+        }
+    }
+
+    Serial::get() << "-- Test async without permission --\n";
+    {
+        MemGate sub = gate.derive(0, sizeof(ulong), MemGate::R);
+        word_t token = sub.write_async(src, sizeof(ulong), 0);
+        assert_false(sub.wait(token));
+    }
+}
+
+void MemoryTestSuite::LargeTestCase::run() {
+    // more than fits into one message and more than the heap could hold
+    const size_t size = 2 * HEAP_SIZE;
+    void *addr = mmap(0, size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if(addr == MAP_FAILED) {
+        LOG(DEF, "mmap failed. Skipping test.");
+        return;
+    }
+    ulong *src = reinterpret_cast<ulong*>(addr);
+    ulong *dst = src + size / sizeof(ulong);
+
+    MemGate gate = MemGate::create_global(size, MemGate::RW);
+
+    Serial::get() << "-- Test large write/read --\n";
+    {
+        for(size_t i = 0; i < size / sizeof(ulong); ++i)
+            src[i] = i;
+        gate.write_sync(src, size, 0);
+        gate.read_sync(dst, size, 0);
+        size_t wrong = 0;
+        for(size_t i = 0; i < size / sizeof(ulong); ++i)
+            wrong += dst[i] != i;
+        assert_size(wrong, 0);
+    }
+
+    munmap(addr, size * 2);
+}
+
+#if defined(__host__)
+void MemoryTestSuite::AtomicTestCase::run() {
+    MemGate gate = MemGate::bind(_mem.sel());
+
+    Serial::get() << "-- Test atomic operations --\n";
+    {
+        write_vmsg(gate, 0, static_cast<word_t>(40), static_cast<word_t>(0x0F));
+        assert_word(gate.fetch_add(2, 0), 40);
+        assert_word(gate.swap(7, 0), 42);
+        assert_word(gate.fetch_or(0xF0, sizeof(word_t)), 0x0F);
+        assert_word(gate.fetch_and(0x3C, sizeof(word_t)), 0xFF);
+
+        word_t data[2];
+        gate.read_sync(data, sizeof(data), 0);
+        assert_word(data[0], 7);
+        assert_word(data[1], 0x3C);
+    }
+
+    Serial::get() << "-- Test counting --\n";
+    {
+        gate.swap(0, 0);
+        for(int i = 0; i < 100; ++i)
+            gate.fetch_add(1, 0);
+        assert_word(gate.fetch_add(0, 0), 100);
+    }
+}
+#endif
+
 void MemoryTestSuite::DeriveTestCase::run() {
     static ulong test[6] = {0};
     MemGate gate = MemGate::bind(_mem.sel());
@@ -31,6 +31,42 @@ private:
         m3::MemGate &_mem;
     };
 
+    class LargeTestCase : public BaseTestCase {
+    public:
+        explicit LargeTestCase() : BaseTestCase("Large transfers") {
+        }
+        virtual void run() override;
+    };
+
+    class VectorTestCase : public BaseTestCase {
+    public:
+        explicit VectorTestCase(m3::MemGate & mem) : BaseTestCase("Scatter-gather"), _mem(mem) {
+        }
+        virtual void run() override;
+    private:
+        m3::MemGate &_mem;
+    };
+
+    class AsyncTestCase : public BaseTestCase {
+    public:
+        explicit AsyncTestCase(m3::MemGate & mem) : BaseTestCase("Asynchronous"), _mem(mem) {
+        }
+        virtual void run() override;
+    private:
+        m3::MemGate &_mem;
+    };
+
+#if defined(__host__)
+    class AtomicTestCase : public BaseTestCase {
+    public:
+        explicit AtomicTestCase(m3::MemGate & mem) : BaseTestCase("Atomics"), _mem(mem) {
+        }
+        virtual void run() override;
+    private:
+        m3::MemGate &_mem;
+    };
+#endif
+
     class DeriveTestCase : public BaseTestCase {
     public:
         explicit DeriveTestCase(m3::MemGate & mem) : BaseTestCase("Derive memory"), _mem(mem) {
@@ -44,6 +80,12 @@ public:
     explicit MemoryTestSuite()
         : TestSuite("Memory"), _mem(m3::MemGate::create_global(0x4000, m3::MemGate::RWX)) {
         add(new SyncTestCase(_mem));
+        add(new VectorTestCase(_mem));
+        add(new AsyncTestCase(_mem));
+        add(new LargeTestCase());
+#if defined(__host__)
+        add(new AtomicTestCase(_mem));
+#endif
         add(new DeriveTestCase(_mem));
     }
 
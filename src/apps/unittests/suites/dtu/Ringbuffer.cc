@@ -14,7 +14,10 @@
  * General Public License version 2 for more details.
  */
 
+#include <m3/cap/SendGate.h>
+#include <m3/cap/VPE.h>
 #include <m3/Config.h>
+#include <m3/Log.h>
 #include <m3/RecvBuf.h>
 #include "Ringbuffer.h"
 
@@ -223,3 +226,60 @@ void RingbufferTestSuite::NoRingNoHeaderTestCase::run() {
 
     dtu.configure(sendepid, 0, 0, 0, 0);
 }
+
+void RingbufferTestSuite::MulticastTestCase::run() {
+    const size_t sendepid = 3;
+    const size_t rcvepids[] = {4, 5};
+    word_t data = 1234;
+    DTU &dtu = DTU::get();
+
+    Serial::get() << "-- Test multicast endpoint --\n";
+    {
+        RecvBuf buf1 = RecvBuf::create(rcvepids[0], nextlog2<128>::val, nextlog2<64>::val, 0);
+        RecvBuf buf2 = RecvBuf::create(rcvepids[1], nextlog2<128>::val, nextlog2<64>::val, 0);
+        word_t *grp = dtu.ep_regs() + DTU::GROUPS_START + sendepid * DTU::GROUPS_RCNT;
+        DTU::configure_group(grp, 0, 0x1111, coreid(), buf1.epid());
+        DTU::configure_group(grp, 1, 0x2222, coreid(), buf2.epid());
+        dtu.configure(sendepid, 0, DTU::MULTICAST_CORE, 2, -1);
+
+        dmasend(&data, sizeof(data), sendepid);
+        DTU::Message *msg1 = getmsgat(buf1.epid(), 1, 0);
+        DTU::Message *msg2 = getmsgat(buf2.epid(), 1, 0);
+        assert_true(msg1->label == 0x1111);
+        assert_true(msg2->label == 0x2222);
+        assert_size(msg1->length, sizeof(data));
+        assert_word(*reinterpret_cast<word_t*>(msg2->data), data);
+
+        dtu.configure(sendepid, 0, 0, 0, 0);
+    }
+
+    Serial::get() << "-- Test multicast gate --\n";
+    {
+        RecvBuf buf1 = RecvBuf::create(VPE::self().alloc_ep(),
+            nextlog2<128>::val, nextlog2<64>::val, 0);
+        RecvBuf buf2 = RecvBuf::create(VPE::self().alloc_ep(),
+            nextlog2<128>::val, nextlog2<64>::val, 0);
+        RecvGate rgate1 = RecvGate::create(&buf1);
+        RecvGate rgate2 = RecvGate::create(&buf2);
+        SendGate sgate1 = SendGate::create(SendGate::UNLIMITED, &rgate1);
+        SendGate sgate2 = SendGate::create(SendGate::UNLIMITED, &rgate2);
+
+        // members need to have unlimited credits
+        SendGate limited = SendGate::create(64, &rgate1);
+        capsel_t invalid[] = {sgate1.sel(), limited.sel()};
+        SendGate fail = SendGate::create_multicast(invalid, ARRAY_SIZE(invalid));
+        assert_int(Errors::last, Errors::INV_ARGS);
+
+        capsel_t members[] = {sgate1.sel(), sgate2.sel()};
+        SendGate mcast = SendGate::create_multicast(members, ARRAY_SIZE(members));
+        assert_int(Errors::last, Errors::NO_ERROR);
+
+        mcast.send_sync(&data, sizeof(data));
+        DTU::Message *msg1 = getmsg(buf1.epid(), 1);
+        DTU::Message *msg2 = getmsg(buf2.epid(), 1);
+        assert_true(msg1->label == rgate1.label());
+        assert_true(msg2->label == rgate2.label());
+        assert_word(*reinterpret_cast<word_t*>(msg1->data), data);
+        assert_word(*reinterpret_cast<word_t*>(msg2->data), data);
+    }
+}
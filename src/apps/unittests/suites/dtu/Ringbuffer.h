@@ -57,6 +57,13 @@ private:
         virtual void run() override;
     };
 
+    class MulticastTestCase : public BaseTestCase {
+    public:
+        explicit MulticastTestCase() : BaseTestCase("Multicast") {
+        }
+        virtual void run() override;
+    };
+
 public:
     explicit RingbufferTestSuite()
         : TestSuite("Ringbuffer") {
@@ -64,5 +71,6 @@ public:
         add(new IterationTestCase());
         add(new NoHeaderTestCase());
         add(new NoRingNoHeaderTestCase());
+        add(new MulticastTestCase());
     }
 };
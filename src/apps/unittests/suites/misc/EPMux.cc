@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <m3/Common.h>
+#include <m3/cap/MemGate.h>
+#include <m3/EPMux.h>
+#include <m3/Log.h>
+#include "EPMux.h"
+
+using namespace m3;
+
+// more gates than endpoints
+static const size_t GATES = EP_COUNT;
+
+static word_t data[2];
+
+static void create_gates(MemGate **gates) {
+    for(size_t i = 0; i < GATES; ++i)
+        gates[i] = new MemGate(MemGate::create_global(0x1000, MemGate::RW));
+}
+
+static void destroy_gates(MemGate **gates) {
+    for(size_t i = 0; i < GATES; ++i)
+        delete gates[i];
+}
+
+void EPMuxTestSuite::LRUTestCase::run() {
+    MemGate *gates[GATES];
+    create_gates(gates);
+
+    Serial::get() << "-- Test that recently used gates stay --\n";
+    {
+        gates[0]->read_sync(data, sizeof(data), 0);
+        size_t ep = gates[0]->epid();
+        size_t before = EPMux::get().activations();
+        for(size_t i = 1; i < GATES; ++i) {
+            gates[i]->read_sync(data, sizeof(data), 0);
+            gates[0]->read_sync(data, sizeof(data), 0);
+            assert_size(gates[0]->epid(), ep);
+        }
+        // every other gate had to be activated once, but gate 0 never again
+        assert_size(EPMux::get().activations() - before, GATES - 1);
+    }
+
+    destroy_gates(gates);
+}
+
+void EPMuxTestSuite::PinTestCase::run() {
+    MemGate *gates[GATES];
+    create_gates(gates);
+
+    Serial::get() << "-- Test that pinned gates stay --\n";
+    {
+        assert_int(gates[0]->pin(), Errors::NO_ERROR);
+        size_t ep = gates[0]->epid();
+        for(int round = 0; round < 2; ++round) {
+            for(size_t i = 1; i < GATES; ++i)
+                gates[i]->read_sync(data, sizeof(data), 0);
+        }
+        assert_size(gates[0]->epid(), ep);
+
+        size_t before = EPMux::get().activations();
+        gates[0]->read_sync(data, sizeof(data), 0);
+        assert_size(EPMux::get().activations(), before);
+        gates[0]->unpin();
+    }
+
+    Serial::get() << "-- Test that one endpoint is left for multiplexing --\n";
+    {
+        size_t pinned = 0;
+        while(pinned < GATES && gates[pinned]->pin() == Errors::NO_ERROR)
+            pinned++;
+        assert_true(pinned < GATES);
+        assert_int(gates[pinned]->pin(), Errors::NO_SPACE);
+
+        // the remaining gates can still be used
+        for(size_t i = pinned; i < GATES; ++i)
+            gates[i]->read_sync(data, sizeof(data), 0);
+
+        for(size_t i = 0; i < pinned; ++i)
+            gates[i]->unpin();
+    }
+
+    destroy_gates(gates);
+}
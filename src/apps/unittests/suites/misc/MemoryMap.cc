@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#include <m3/Common.h>
+#include <m3/Log.h>
+#include "../../../kernel/MemoryMap.h"
+#include "MemoryMap.h"
+
+using namespace m3;
+
+static const uintptr_t BASE = 0x1000;
+static const size_t SIZE    = 0x10000;
+
+void MemoryMapTestSuite::AlignTestCase::run() {
+    MemoryMap map(BASE, SIZE);
+    size_t areas;
+
+    assert_word(map.allocate(0x10), BASE);
+    // skips the rest of the first page and leaves it as a separate area
+    assert_word(map.allocate(0x100, 0x1000), BASE + 0x1000);
+    assert_size(map.get_size(&areas), SIZE - 0x110);
+    assert_size(areas, 2);
+    assert_size(map.largest(), SIZE - 0x1100);
+    assert_uint(map.fragmentation(), 7);
+
+    uintptr_t addr = map.allocate(0x800, 0x800);
+    assert_true(addr != static_cast<uintptr_t>(-1));
+    assert_word(addr & 0x7FF, 0);
+
+    // the size would fit, but not at the requested alignment
+    assert_word(map.allocate(SIZE - 0x2000, 0x8000), static_cast<uintptr_t>(-1));
+
+    map.free(addr, 0x800);
+    map.free(BASE + 0x1000, 0x100);
+    map.free(BASE, 0x10);
+    assert_size(map.get_size(&areas), SIZE);
+    assert_size(areas, 1);
+
+    // now the whole map can be allocated at its (only) aligned address
+    assert_word(map.allocate(SIZE, 0x1000), BASE);
+    assert_word(map.allocate(1), static_cast<uintptr_t>(-1));
+    assert_size(map.largest(), 0);
+    assert_uint(map.fragmentation(), 0);
+}
+
+void MemoryMapTestSuite::CoalesceTestCase::run() {
+    const size_t CHUNK = 0x400;
+    const size_t COUNT = SIZE / CHUNK;
+    MemoryMap map(BASE, SIZE);
+    size_t areas;
+
+    for(size_t i = 0; i < COUNT; ++i)
+        assert_word(map.allocate(CHUNK), BASE + i * CHUNK);
+    assert_size(map.get_size(&areas), 0);
+    assert_size(areas, 0);
+
+    // every second chunk leaves lots of small areas that can't be merged
+    for(size_t i = 0; i < COUNT; i += 2)
+        map.free(BASE + i * CHUNK, CHUNK);
+    assert_size(map.get_size(&areas), SIZE / 2);
+    assert_size(areas, COUNT / 2);
+    assert_size(map.largest(), CHUNK);
+    assert_uint(map.fragmentation(), 97);
+    assert_word(map.allocate(CHUNK * 2), static_cast<uintptr_t>(-1));
+
+    // fill the gaps in an order that is unrelated to the address, so that the areas to merge are
+    // at arbitrary positions in the tree
+    for(size_t i = 0; i < COUNT / 2; ++i) {
+        size_t idx = (i * 7) % (COUNT / 2);
+        map.free(BASE + (idx * 2 + 1) * CHUNK, CHUNK);
+    }
+    assert_size(map.get_size(&areas), SIZE);
+    assert_size(areas, 1);
+    assert_size(map.largest(), SIZE);
+    assert_uint(map.fragmentation(), 0);
+}
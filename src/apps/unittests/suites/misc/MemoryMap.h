@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <test/TestSuite.h>
+
+class MemoryMapTestSuite : public test::TestSuite {
+private:
+    class AlignTestCase : public test::TestCase {
+    public:
+        explicit AlignTestCase() : test::TestCase("Aligned allocation") {
+        }
+        virtual void run() override;
+    };
+    class CoalesceTestCase : public test::TestCase {
+    public:
+        explicit CoalesceTestCase() : test::TestCase("Coalescing and fragmentation") {
+        }
+        virtual void run() override;
+    };
+
+public:
+    explicit MemoryMapTestSuite()
+        : TestSuite("MemoryMap") {
+        add(new AlignTestCase());
+        add(new CoalesceTestCase());
+    }
+};
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#include <m3/Common.h>
+#include <m3/cap/MemGate.h>
+#include <m3/cap/Session.h>
+#include <m3/cap/VPE.h>
+#include <m3/server/Server.h>
+#include <m3/Syscalls.h>
+#include <m3/Log.h>
+#include "Syscalls.h"
+
+using namespace m3;
+
+void SyscallsTestSuite::BatchTestCase::run() {
+    static ulong data[4];
+    capsel_t caps = VPE::self().alloc_caps(3);
+
+    Serial::get() << "-- Test successful batch --\n";
+    {
+        Syscalls::Batch batch;
+        assert_true(batch.reqmem(caps + 0, 0x1000, MemGate::RW));
+        assert_true(batch.derivemem(caps + 0, caps + 1, 0, 0x100, MemGate::RW));
+        assert_true(batch.derivemem(caps + 0, caps + 2, 0x100, 0x100, MemGate::R));
+        assert_size(batch.count(), 3);
+
+        assert_int(Syscalls::get().batch(batch), Errors::NO_ERROR);
+        assert_size(batch.executed(), 3);
+        for(size_t i = 0; i < batch.executed(); ++i)
+            assert_int(batch.result(i), Errors::NO_ERROR);
+
+        // the derived ones refer to the requested memory
+        MemGate mem = MemGate::bind(caps + 0);
+        MemGate der = MemGate::bind(caps + 1);
+        data[0] = 1;
+        data[1] = 2;
+        der.write_sync(data, sizeof(data), 0);
+        data[0] = data[1] = 0;
+        mem.read_sync(data, sizeof(data), 0);
+        assert_word(data[0], 1);
+        assert_word(data[1], 2);
+    }
+
+    Serial::get() << "-- Test stop on error --\n";
+    {
+        Syscalls::Batch batch;
+        assert_true(batch.revoke(CapRngDesc(caps + 2)));
+        // the destination is still in use
+        assert_true(batch.derivemem(caps + 0, caps + 1, 0, 0x100, MemGate::RW));
+        assert_true(batch.revoke(CapRngDesc(caps + 1)));
+
+        assert_int(Syscalls::get().batch(batch), Errors::INV_ARGS);
+        assert_size(batch.executed(), 2);
+        assert_int(batch.result(0), Errors::NO_ERROR);
+        assert_int(batch.result(1), Errors::INV_ARGS);
+
+        // the first revoke has been executed, the second one hasn't
+        batch.clear();
+        assert_true(batch.derivemem(caps + 0, caps + 2, 0, 0x100, MemGate::RW));
+        assert_true(batch.derivemem(caps + 0, caps + 1, 0, 0x100, MemGate::RW));
+        assert_int(Syscalls::get().batch(batch), Errors::INV_ARGS);
+        assert_size(batch.executed(), 2);
+    }
+
+    Serial::get() << "-- Test full batch --\n";
+    {
+        Syscalls::Batch batch;
+        size_t count = 0;
+        while(batch.revoke(CapRngDesc(caps + 2)))
+            count++;
+        assert_true(count > 1);
+        assert_size(batch.count(), count);
+        batch.clear();
+        assert_size(batch.count(), 0);
+    }
+
+    Syscalls::get().revoke(CapRngDesc(caps, 3));
+    VPE::self().free_caps(caps, 3);
+}
+
+void SyscallsTestSuite::RevokeTestCase::run() {
+    // leave enough selectors for the other tests and the VPE itself
+    const size_t DEPTH = CAP_TOTAL / 4;
+    static ulong data[2];
+    capsel_t caps = VPE::self().alloc_caps(DEPTH);
+
+    Serial::get() << "-- Test revoke of deep tree --\n";
+    {
+        // build a chain and let the last one have some siblings
+        assert_int(Syscalls::get().reqmem(caps + 0, 0x1000, MemGate::RW), Errors::NO_ERROR);
+        for(size_t i = 1; i < DEPTH - 4; ++i)
+            assert_int(Syscalls::get().derivemem(caps + i - 1, caps + i, 0, 0x100, MemGate::RW), Errors::NO_ERROR);
+        for(size_t i = DEPTH - 4; i < DEPTH; ++i)
+            assert_int(Syscalls::get().derivemem(caps + DEPTH - 5, caps + i, 0, 0x100, MemGate::RW), Errors::NO_ERROR);
+
+        // use one of them to have an endpoint that needs to be invalidated
+        {
+            MemGate leaf = MemGate::bind(caps + DEPTH - 1);
+            data[0] = 42;
+            leaf.write_sync(data, sizeof(data), 0);
+        }
+
+        size_t removed = 0;
+        assert_int(Syscalls::get().revoke(CapRngDesc(caps + 0), &removed), Errors::NO_ERROR);
+        assert_size(removed, DEPTH);
+
+        // all selectors are free again
+        for(size_t i = 1; i < DEPTH; ++i)
+            assert_int(Syscalls::get().reqmem(caps + i, 0x100, MemGate::RW), Errors::NO_ERROR);
+        assert_int(Syscalls::get().revoke(CapRngDesc(caps + 1, DEPTH - 1), &removed), Errors::NO_ERROR);
+        assert_size(removed, DEPTH - 1);
+    }
+
+    VPE::self().free_caps(caps, DEPTH);
+}
+
+void SyscallsTestSuite::ReqMemTestCase::run() {
+    const size_t COUNT = 32;
+    static ulong data[2];
+    capsel_t caps = VPE::self().alloc_caps(COUNT);
+
+    Serial::get() << "-- Test mixed allocations and frees --\n";
+    {
+        for(size_t i = 0; i < COUNT; ++i)
+            assert_int(Syscalls::get().reqmem(caps + i, (i + 1) * 0x100, MemGate::RW), Errors::NO_ERROR);
+        // free every second one and allocate them again with different sizes
+        for(size_t i = 0; i < COUNT; i += 2)
+            assert_int(Syscalls::get().revoke(CapRngDesc(caps + i)), Errors::NO_ERROR);
+        for(size_t i = 0; i < COUNT; i += 2)
+            assert_int(Syscalls::get().reqmem(caps + i, (COUNT - i) * 0x80, MemGate::RW), Errors::NO_ERROR);
+
+        // the areas must not overlap
+        for(size_t i = 0; i < COUNT; ++i) {
+            MemGate mem = MemGate::bind(caps + i);
+            data[0] = i;
+            data[1] = ~i;
+            mem.write_sync(data, sizeof(data), 0);
+        }
+        for(size_t i = 0; i < COUNT; ++i) {
+            MemGate mem = MemGate::bind(caps + i);
+            mem.read_sync(data, sizeof(data), 0);
+            assert_word(data[0], i);
+            assert_word(data[1], ~i);
+        }
+
+        assert_int(Syscalls::get().revoke(CapRngDesc(caps, COUNT)), Errors::NO_ERROR);
+    }
+
+    Serial::get() << "-- Test too large allocation --\n";
+    {
+        assert_int(Syscalls::get().reqmem(caps, static_cast<size_t>(-1) & ~MemGate::RWX, MemGate::RW),
+            Errors::OUT_OF_MEM);
+    }
+
+    VPE::self().free_caps(caps, COUNT);
+}
+
+void SyscallsTestSuite::SyscStatTestCase::run() {
+    Serial::get() << "-- Test calls and histogram --\n";
+    {
+        // NOOPs are recorded without the kernel lock and others might do them as well
+        Syscalls::Stat before, after;
+        assert_int(Syscalls::get().syscstat(Syscalls::NOOP, before), Errors::NO_ERROR);
+        for(int i = 0; i < 10; ++i)
+            Syscalls::get().noop();
+        assert_int(Syscalls::get().syscstat(Syscalls::NOOP, after), Errors::NO_ERROR);
+        assert_true(after.calls - before.calls >= 10);
+        assert_word(after.errors, before.errors);
+
+        // all other syscalls are recorded with the lock held, so that the snapshot is consistent
+        Syscalls::Stat st;
+        assert_int(Syscalls::get().syscstat(Syscalls::SYSCSTAT, st), Errors::NO_ERROR);
+        word_t total = 0;
+        for(size_t i = 0; i < Syscalls::STAT_BUCKETS; ++i)
+            total += st.hist[i];
+        assert_word(total, st.calls);
+    }
+
+    Serial::get() << "-- Test errors --\n";
+    {
+        Syscalls::Stat before, after;
+        assert_int(Syscalls::get().syscstat(Syscalls::REVOKE, before), Errors::NO_ERROR);
+        assert_int(Syscalls::get().revoke(CapRngDesc(0)), Errors::INV_ARGS);
+        assert_int(Syscalls::get().syscstat(Syscalls::REVOKE, after), Errors::NO_ERROR);
+        assert_word(after.calls - before.calls, 1);
+        assert_word(after.errors - before.errors, 1);
+
+        Syscalls::Stat st;
+        assert_int(Syscalls::get().syscstat(Syscalls::COUNT, st), Errors::INV_ARGS);
+    }
+}
+
+// the OPEN messages with these arguments are larger than the slots of a default server
+static const size_t QUEUE_CLIENTS   = 3;
+static const size_t QUEUE_ARGS      = 40;
+
+static word_t queue_arg(size_t client, size_t i) {
+    return (client << 16) | i;
+}
+
+class QueueHandler : public Handler<> {
+public:
+    explicit QueueHandler() : Handler<>(), srv(), opens(), invalid() {
+    }
+
+    virtual void handle_open(GateIStream &args) override {
+        size_t client;
+        args >> client;
+        for(size_t i = 1; i < QUEUE_ARGS; ++i) {
+            word_t val;
+            args >> val;
+            if(val != queue_arg(client, i)) {
+                invalid++;
+                break;
+            }
+        }
+        Handler<>::handle_open(args);
+
+        if(++opens == QUEUE_CLIENTS)
+            srv->shutdown();
+    }
+
+    Server<QueueHandler> *srv;
+    size_t opens;
+    size_t invalid;
+};
+
+void SyscallsTestSuite::ServiceQueueTestCase::run() {
+    Serial::get() << "-- Test too large arguments --\n";
+    {
+        StaticGateOStream<QUEUE_ARGS * sizeof(word_t)> args;
+        for(size_t i = 0; i < QUEUE_ARGS; ++i)
+            args << queue_arg(0, i);
+        // m3fs has the default message size, so that the kernel refuses to forward it
+        Session sess("m3fs", args);
+        assert_false(sess.is_connected());
+    }
+
+    Serial::get() << "-- Test large arguments to a busy service --\n";
+    {
+        Syscalls::Stat before, now;
+        assert_int(Syscalls::get().syscstat(Syscalls::CREATESESS, before), Errors::NO_ERROR);
+
+        QueueHandler hdl;
+        hdl.srv = new Server<QueueHandler>("unittest-queue", &hdl,
+            nextlog2<Server<QueueHandler>::DEF_BUFSIZE>::val, nextlog2<512>::val);
+
+        VPE *clients[QUEUE_CLIENTS];
+        for(size_t c = 0; c < QUEUE_CLIENTS; ++c) {
+            clients[c] = new VPE("client");
+            assert_int(clients[c]->run([c] {
+                StaticGateOStream<QUEUE_ARGS * sizeof(word_t)> args;
+                args << c;
+                for(size_t i = 1; i < QUEUE_ARGS; ++i)
+                    args << queue_arg(c, i);
+                Session sess("unittest-queue", args);
+                return sess.is_connected() ? 0 : 1;
+            }), Errors::NO_ERROR);
+        }
+
+        // as long as we don't handle the OPENs, the service accepts only one of them and the
+        // kernel has to queue the others
+        do
+            assert_int(Syscalls::get().syscstat(Syscalls::CREATESESS, now), Errors::NO_ERROR);
+        while(now.calls - before.calls < QUEUE_CLIENTS);
+        WorkLoop::get().run();
+
+        for(size_t c = 0; c < QUEUE_CLIENTS; ++c) {
+            assert_int(clients[c]->wait(), 0);
+            delete clients[c];
+        }
+        delete hdl.srv;
+
+        assert_size(hdl.opens, QUEUE_CLIENTS);
+        assert_size(hdl.invalid, 0);
+    }
+}
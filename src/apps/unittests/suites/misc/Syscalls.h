@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+
+#pragma once
+
+#include <test/TestSuite.h>
+
+class SyscallsTestSuite : public test::TestSuite {
+private:
+    class BatchTestCase : public test::TestCase {
+    public:
+        explicit BatchTestCase() : test::TestCase("Batch") {
+        }
+        virtual void run() override;
+    };
+    class RevokeTestCase : public test::TestCase {
+    public:
+        explicit RevokeTestCase() : test::TestCase("Revoke") {
+        }
+        virtual void run() override;
+    };
+    class ReqMemTestCase : public test::TestCase {
+    public:
+        explicit ReqMemTestCase() : test::TestCase("ReqMem") {
+        }
+        virtual void run() override;
+    };
+
+    class SyscStatTestCase : public test::TestCase {
+    public:
+        explicit SyscStatTestCase() : test::TestCase("SyscStat") {
+        }
+        virtual void run() override;
+    };
+    class ServiceQueueTestCase : public test::TestCase {
+    public:
+        explicit ServiceQueueTestCase() : test::TestCase("ServiceQueue") {
+        }
+        virtual void run() override;
+    };
+
+public:
+    explicit SyscallsTestSuite()
+        : TestSuite("Syscalls") {
+        add(new BatchTestCase());
+        add(new RevokeTestCase());
+        add(new ReqMemTestCase());
+        add(new SyscStatTestCase());
+        add(new ServiceQueueTestCase());
+    }
+};
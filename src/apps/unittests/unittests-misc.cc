@@ -18,11 +18,17 @@
 #include <test/TestSuiteContainer.h>
 
 #include "suites/misc/BitField.h"
+#include "suites/misc/EPMux.h"
 #include "suites/misc/Heap.h"
+#include "suites/misc/MemoryMap.h"
+#include "suites/misc/Syscalls.h"
 
 int main() {
     test::TestSuiteContainer con;
     con.add(new BitFieldTestSuite());
+    con.add(new EPMuxTestSuite());
     con.add(new HeapTestSuite());
+    con.add(new MemoryMapTestSuite());
+    con.add(new SyscallsTestSuite());
     return con.run();
 }
@@ -18,6 +18,7 @@
 
 #include <m3/Common.h>
 #include <m3/Config.h>
+#include <m3/Errors.h>
 #include <assert.h>
 
 namespace m3 {
@@ -37,7 +38,8 @@ public:
 
 /**
  * The endpoint multiplexer allows us to have more gates than endpoints by multiplexing
- * the endpoints among the gates.
+ * the endpoints among the gates. If there is no free endpoint, the least recently used one is
+ * taken away from its gate, unless the gate has been pinned to it.
  */
 class EPMux {
     explicit EPMux();
@@ -76,6 +78,40 @@ public:
      */
     void switch_to(Gate *gate);
 
+    /**
+     * Notes that endpoint <ep> has just been used, which is considered when picking a victim.
+     *
+     * @param ep the endpoint id
+     */
+    void touch(size_t ep) {
+        if(ep < EP_COUNT)
+            _lastuse[ep] = ++_tick;
+    }
+
+    /**
+     * Pins <gate> to an endpoint, i.e., configures an endpoint for it, if necessary, and never
+     * picks that endpoint as a victim until the gate is unpinned or removed. This avoids the
+     * switches for frequently used gates. At least one endpoint is always left for multiplexing.
+     *
+     * @param gate the gate
+     * @return the error, if any (NO_SPACE if all other endpoints are pinned or reserved)
+     */
+    Errors::Code pin(Gate *gate);
+
+    /**
+     * Allows to pick the endpoint of <gate> as a victim again.
+     *
+     * @param gate the gate
+     */
+    void unpin(Gate *gate);
+
+    /**
+     * @return the number of times an endpoint has been configured for a gate via switch_to
+     */
+    size_t activations() const {
+        return _activations;
+    }
+
     /**
      * If <gate> is already configured on some endpoint, it exchanges the configuration to use the
      * one from the capability <newcap>. If it is not configured somewhere, nothing happens.
@@ -101,10 +137,15 @@ public:
 
 private:
     size_t select_victim();
+    size_t multiplexable() const;
 
-    size_t _next_victim;
+    size_t _tick;
+    size_t _activations;
     EPSwitcher *_epsw;
     Gate *_gates[EP_COUNT];
+    // the time of the last use of each endpoint, in calls of touch()
+    size_t _lastuse[EP_COUNT];
+    bool _pinned[EP_COUNT];
     static EPMux _inst;
 };
 
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2015, Nils Asmussen <nils@os.inf.tu-dresden.de>
+ * Economic rights: Technische Universitaet Dresden (Germany)
+ *
+ * This file is part of M3 (Microkernel-based SysteM for Heterogeneous Manycores).
+ *
+ * M3 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * M3 is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License version 2 for more details.
+ */
+
+#pragma once
+
+#include <m3/Common.h>
+
+namespace m3 {
+
+/**
+ * Describes one part of the data for a scatter-gather transfer (see MemGate::readv, for example).
+ * Like for the other transfers, <base> and <len> should be aligned to DTU_PKG_SIZE.
+ */
+struct IOVec {
+    void *base;
+    size_t len;
+
+    /**
+     * @return the total number of bytes in the given <count> parts at <iov>
+     */
+    static size_t total(const IOVec *iov, size_t count) {
+        size_t len = 0;
+        for(size_t i = 0; i < count; ++i)
+            len += iov[i].len;
+        return len;
+    }
+};
+
+}
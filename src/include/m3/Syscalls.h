@@ -19,6 +19,7 @@
 #include <m3/cap/SendGate.h>
 #include <m3/util/String.h>
 #include <m3/CapRngDesc.h>
+#include <m3/Marshalling.h>
 
 namespace m3 {
 
@@ -35,6 +36,7 @@ public:
         CREATESRV,
         CREATESESS,
         CREATEGATE,
+        CREATEMCAST,
         CREATEVPE,
         ATTACHRB,
         DETACHRB,
@@ -48,6 +50,8 @@ public:
         REVOKE,
         EXIT,
         NOOP,
+        BATCH,
+        SYSCSTAT,
 #if defined(__host__)
         INIT,
 #endif
@@ -59,10 +63,104 @@ public:
         VCTRL_WAIT,
     };
 
+    // the number of buckets of the latency histograms and the number the kernel sends per message
+    static constexpr size_t STAT_BUCKETS            = 32;
+    static constexpr size_t STAT_BUCKETS_PER_MSG    = 4;
+
+    /**
+     * The statistics the kernel keeps for a syscall. The cycles are the ones the kernel spent for
+     * handling it, i.e., without the time a service took to answer. Bucket i of the histogram
+     * counts the calls that took [2^i, 2^(i+1)) cycles; the last one includes all longer calls.
+     * Errors are only the ones the kernel detected itself.
+     */
+    struct Stat {
+        word_t calls;
+        word_t errors;
+        cycles_t cycles;
+        word_t hist[STAT_BUCKETS];
+    };
+
+    /**
+     * Collects syscalls to let the kernel execute them with a single message. The kernel executes
+     * them in order and stops at the first one that fails. Only the syscalls that the kernel can
+     * finish on its own can be batched, i.e., not the ones that involve services or other VPEs.
+     */
+    class Batch {
+        friend class Syscalls;
+
+    public:
+        explicit Batch() : _count(), _executed(), _error(), _os(_bytes, sizeof(_bytes)) {
+        }
+        Batch(const Batch &) = delete;
+        Batch &operator=(const Batch &) = delete;
+
+        /**
+         * The following add the corresponding syscall to the batch.
+         *
+         * @return false if it does not fit into the message anymore
+         */
+        bool creategate(capsel_t vpe, capsel_t dst, label_t label, size_t ep, word_t credits);
+        bool attachrb(capsel_t vpe, size_t ep, uintptr_t addr, int order, int msgorder, uint flags);
+        bool detachrb(capsel_t vpe, size_t ep);
+        bool exchange(capsel_t vpe, const CapRngDesc &own, const CapRngDesc &other, bool obtain);
+        bool reqmem(capsel_t cap, size_t size, int perms) {
+            return reqmemat(cap, -1, size, perms);
+        }
+        bool reqmemat(capsel_t cap, uintptr_t addr, size_t size, int perms);
+        bool derivemem(capsel_t src, capsel_t dst, size_t offset, size_t size, int perms);
+        bool revoke(const CapRngDesc &crd);
+
+        /**
+         * @return the number of added syscalls
+         */
+        size_t count() const {
+            return _count;
+        }
+        /**
+         * @return the number of syscalls the kernel has executed, including the failed one
+         */
+        size_t executed() const {
+            return _executed;
+        }
+        /**
+         * @param i the index of an executed syscall
+         * @return the result of it
+         */
+        Errors::Code result(size_t i) const {
+            assert(i < _executed);
+            return i + 1 == _executed ? _error : Errors::NO_ERROR;
+        }
+
+        /**
+         * Removes all syscalls to reuse this batch.
+         */
+        void clear() {
+            _count = _executed = 0;
+            _error = Errors::NO_ERROR;
+            _os = Marshaller(_bytes, sizeof(_bytes));
+        }
+
+    private:
+        template<typename... Args>
+        bool add(Operation op, const Args &... args);
+
+        size_t _count;
+        size_t _executed;
+        Errors::Code _error;
+        Marshaller _os;
+        alignas(DTU_PKG_SIZE) unsigned char _bytes[MSGSIZE];
+    };
+
     static Syscalls &get() {
         return _inst;
     }
 
+    /**
+     * @param op the operation
+     * @return the name of the given operation
+     */
+    static const char *to_string(Operation op);
+
 private:
     explicit Syscalls() : _gate(Cap::INVALID, 0, nullptr,DTU::SYSC_EP) {
 #if defined(__host__)
@@ -76,6 +174,7 @@ public:
     Errors::Code createsrv(capsel_t gate, capsel_t srv, const String &name);
     Errors::Code createsess(capsel_t cap, const String &name, const GateOStream &args);
     Errors::Code creategate(capsel_t vpe, capsel_t dst, label_t label, size_t ep, word_t credits);
+    Errors::Code createmcast(capsel_t dst, const capsel_t *members, size_t count);
     Errors::Code createvpe(capsel_t vpe, capsel_t mem, const String &name, const String &core);
     Errors::Code attachrb(capsel_t vpe, size_t ep, uintptr_t addr, int order, int msgorder, uint flags);
     Errors::Code detachrb(capsel_t vpe, size_t ep);
@@ -91,12 +190,20 @@ public:
     }
     Errors::Code reqmemat(capsel_t cap, uintptr_t addr, size_t size, int perms);
     Errors::Code derivemem(capsel_t src, capsel_t dst, size_t offset, size_t size, int perms);
-    Errors::Code revoke(const CapRngDesc &crd);
+    // <removed> receives the number of capabilities that have been revoked, including the children
+    Errors::Code revoke(const CapRngDesc &crd, size_t *removed = nullptr);
     void exit(int exitcode);
     void noop();
+    Errors::Code batch(Batch &batch);
+    Errors::Code syscstat(Operation op, Stat &stat);
 
 #if defined(__host__)
     void init(void *sepregs);
+    /**
+     * Starts the given VPE, which runs in the process <pid>, and receives its startup parameters
+     * from the kernel. The shared parameters are taken from our own configuration.
+     */
+    Errors::Code vpestart(capsel_t vpe, int pid, Config::Params &params);
 #endif
 
 private:
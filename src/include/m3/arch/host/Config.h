@@ -27,10 +27,11 @@ namespace m3 {
 #define MEMORY_CORE         0
 #define KERNEL_CORE         0
 #define APP_CORES           1
-#define MAX_CORES           18
+// cores are just processes on host, so that we can emulate large manycores
+#define MAX_CORES           65
 #define AVAIL_PES           (MAX_CORES - 1)
-#define PE_MASK             0xFFFFFFFF
-#define CAP_TOTAL           128
+#define PE_MASK             0xFFFFFFFFFFFFFFFFULL
+#define CAP_TOTAL           512
 #define FS_IMG_OFFSET       0x0
 
 // leave the first 64 MiB for the filesystem
@@ -46,6 +47,21 @@ class Config {
     };
 
 public:
+    /**
+     * The parameters a VPE gets on startup. They are written to a pipe by the kernel, if it starts
+     * the VPE, or by the parent VPE in front of its state, if the VPE is started via VPE::run or
+     * VPE::exec. Thus, starting a VPE does not touch the filesystem.
+     */
+    struct Params {
+        char shm_prefix[32];
+        int core;
+        label_t sysc_label;
+        size_t sysc_epid;
+        word_t sysc_credits;
+        int dram_fd;
+        uintptr_t dram_base;
+    };
+
     static Config &get() {
         assert(_inst != nullptr);
         return *_inst;
@@ -66,7 +82,12 @@ public:
     explicit Config(int core, const char *shmprefix);
     ~Config();
 
-    void reset();
+    /**
+     * Re-initializes this VPE after it has been forked by VPE::run.
+     *
+     * @param fd the pipe to read the parameters from
+     */
+    void reset(int fd);
 
     RecvGate *mem_rcvgate() {
         return _mem_recvgate;
@@ -92,12 +113,18 @@ public:
     const String &shm_prefix() const {
         return _shm_prefix;
     }
+    /**
+     * Fills the parameters that are equal for all VPEs, i.e., the shm prefix and the DRAM.
+     *
+     * @param p the parameters
+     */
+    void shared_params(Params &p) const;
     void print() const;
 
 private:
     void init();
     void init_dtu();
-    static bool set_params(Config *env, const char *shm_prefix, bool is_kernel);
+    static bool set_params(Config *env, const char *shm_prefix, bool is_kernel, int fd);
     static void init_executable();
 
     int _core;
@@ -106,7 +133,10 @@ private:
     label_t _sysc_label;
     size_t _sysc_epid;
     word_t _sysc_credits;
+    int _dram_fd;
+    uintptr_t _dram_base;
     bool _is_kernel;
+    void *_dram;
     pthread_mutex_t _log_mutex;
     RecvBuf _mem_recvbuf;
     RecvBuf _def_recvbuf;
@@ -17,12 +17,16 @@
 #pragma once
 
 #include <m3/Common.h>
+#include <m3/IOVec.h>
 #include <m3/util/String.h>
 #include <m3/util/Util.h>
 #include <pthread.h>
+#include <atomic>
 #include <ostream>
 #include <iomanip>
 #include <assert.h>
+#include <string.h>
+#include <unistd.h>
 
 // bad place, but prevents circular dependencies of headers
 #define HEAP_SIZE           (1024 * 1024)
@@ -31,25 +35,25 @@
 #define DTU_PKG_SIZE        (static_cast<size_t>(8))
 #define EP_COUNT          16
 
-#define USE_MSGBACKEND      0
-
 namespace m3 {
 
 class Gate;
 class RecvGate;
 class MsgBackend;
 class SocketBackend;
+class ShmBackend;
+class RecordBackend;
+class ReplayBackend;
 
 class DTU {
     friend class Gate;
     friend class MsgBackend;
     friend class SocketBackend;
+    friend class ShmBackend;
+    friend class RecordBackend;
+    friend class ReplayBackend;
 
-#if USE_MSGBACKEND
-    static constexpr size_t MAX_DATA_SIZE   = 8192 - (sizeof(long int) + sizeof(word_t) * 4);
-#else
     static constexpr size_t MAX_DATA_SIZE   = HEAP_SIZE;
-#endif
 
     struct Header {
         long int length;        // = mtype -> has to be non-zero
@@ -91,10 +95,53 @@ public:
         virtual void reset() = 0;
         virtual void send(int core, int ep, const DTU::Buffer *buf) = 0;
         virtual ssize_t recv(int ep, DTU::Buffer *buf) = 0;
+
+        /**
+         * Returns the endpoints that might have received a message since the last call as a
+         * bitmap. The DTU thread only calls recv for these and keeps calling it for an endpoint
+         * as long as it finds messages. By default, all endpoints are considered.
+         */
+        virtual word_t fetch_pending() {
+            return ALL_EPS;
+        }
+
+        /**
+         * Sends a message whose last <len> bytes are at <data> and the rest is in <buf>. That is,
+         * buf->length includes <len>. By default, the data is copied into <buf> first.
+         */
+        virtual void sendv(int core, int ep, DTU::Buffer *buf, const void *data, size_t len) {
+            memcpy(buf->data + buf->length - len, data, len);
+            send(core, ep, buf);
+        }
+        /**
+         * @return the maximum message length for memory transfers. Larger transfers are split
+         *  into multiple messages, which are sent one after another without waiting.
+         */
+        virtual size_t chunk_size() const {
+            return 64 * 1024;
+        }
+
+        /**
+         * Blocks the DTU thread until there might be something to do, i.e., a message has been
+         * sent to us or notify() has been called. By default, it simply waits a bit.
+         */
+        virtual void wait() {
+            usleep(1);
+        }
+        /**
+         * Wakes up the DTU thread of this core, if it is blocked in wait().
+         */
+        virtual void notify() {
+        }
     };
 
     static constexpr size_t HEADER_SIZE         = sizeof(Buffer) - MAX_DATA_SIZE;
 
+    // bitmaps of endpoints are single words
+    static_assert(EP_COUNT <= sizeof(word_t) * 8, "Too many endpoints");
+    static constexpr word_t ALL_EPS             =
+        static_cast<word_t>(-1) >> (sizeof(word_t) * 8 - EP_COUNT);
+
     static constexpr size_t MAX_MSGS            = sizeof(word_t) * 8;
 
     // command registers
@@ -110,6 +157,9 @@ public:
     // register starts and counts (cont.)
     static constexpr size_t CMDS_RCNT           = 1 + CMD_LENGTH;
 
+    // number of commands that can be queued in addition to the command registers
+    static constexpr size_t CMDQ_SIZE           = 8;
+
     // receive buffer registers
     static constexpr size_t EP_BUF_ADDR         = 0;
     static constexpr size_t EP_BUF_ORDER        = 1;
@@ -126,6 +176,16 @@ public:
     static constexpr size_t EP_LABEL            = 10;
     static constexpr size_t EP_CREDITS          = 11;
 
+    // a send endpoint with this core id is a multicast endpoint. EP_EPID holds the number of
+    // members, which are described by the group registers of the endpoint
+    static constexpr int MULTICAST_CORE         = -1;
+    static constexpr size_t GROUP_MAX_MEMBERS   = 16;
+
+    // group registers (per member)
+    static constexpr size_t GRP_LABEL           = 0;
+    static constexpr size_t GRP_COREID          = 1;
+    static constexpr size_t GRP_EPID            = 2;
+
     // bits in EP_BUF_FLAGS register
     static constexpr word_t FLAG_NO_RINGBUF     = 0x1;
     static constexpr word_t FLAG_NO_HEADER      = 0x2;
@@ -134,9 +194,16 @@ public:
     static constexpr word_t CTRL_START          = 0x1;
     static constexpr word_t CTRL_DEL_REPLY_CAP  = 0x2;
     static constexpr word_t CTRL_ERROR          = 0x4;
+    // above the opcode: CMD_ADDR points to CMD_SIZE IOVecs instead of the data
+    static constexpr word_t CTRL_IOVEC          = 0x100;
 
     // register counts (cont.)
     static constexpr size_t EPS_RCNT            = 1 + EP_CREDITS;
+    static constexpr size_t GRP_RCNT            = 1 + GRP_EPID;
+    static constexpr size_t GROUPS_RCNT         = GRP_RCNT * GROUP_MAX_MEMBERS;
+    // the group registers of all endpoints follow the endpoint registers
+    static constexpr size_t GROUPS_START        = EPS_RCNT * EP_COUNT;
+    static constexpr size_t ALL_EPS_RCNT        = GROUPS_START + GROUPS_RCNT * EP_COUNT;
 
     enum Op {
         READ    = 0,
@@ -147,6 +214,56 @@ public:
         RESP    = 5,
         SENDCRD = 6,
         ACKMSG  = 7,
+        // atomic operations on a word; CMD_ADDR points to the operand, which is replaced by the
+        // previous value of the word in memory
+        FETCH_ADD   = 8,
+        SWAP        = 9,
+        FETCH_OR    = 10,
+        FETCH_AND   = 11,
+    };
+
+    struct EpStats {
+        uint64_t msgs_sent;
+        uint64_t bytes_sent;
+        uint64_t msgs_recv;
+        uint64_t bytes_recv;
+        // send commands that failed because of insufficient credits
+        uint64_t credit_stalls;
+        // messages that have been dropped because the receive buffer was full
+        uint64_t drops;
+    };
+
+    /**
+     * Counters of this DTU, which are always collected. They can be printed by sending SIGQUIT
+     * to the process (Ctrl+\ does that for all processes of M3).
+     */
+    struct Stats {
+        EpStats eps[EP_COUNT];
+        uint64_t reads;
+        uint64_t writes;
+        uint64_t cmpxchgs;
+        uint64_t atomics;
+        // finished commands and the cycles from fetching them until they were finished
+        uint64_t cmds;
+        cycles_t cmd_cycles;
+        cycles_t cmd_cycles_max;
+        // the time injected by the timing model
+        uint64_t delay_ns;
+    };
+
+    /**
+     * An optional model of the transfer time of the hardware targets, which is applied to every
+     * message and DRAM access. It is configured by the environment variables M3_DTU_LATENCY
+     * (ns per message), M3_DTU_BANDWIDTH (MB/s) and M3_DTU_HOP_LATENCY (ns per NoC hop).
+     */
+    struct Timing {
+        // the cores are placed row by row in a mesh with this number of columns
+        static constexpr int NOC_COLUMNS    = 8;
+
+        bool enabled;
+        uint64_t msg_ns;
+        uint64_t bandwidth;
+        uint64_t hop_ns;
     };
 
     static const int MEM_EP       = 0;
@@ -162,6 +279,9 @@ public:
     }
     void set_cmd(size_t reg, word_t val) {
         _cmdregs[reg] = val;
+        // let the DTU thread know that there is a new command
+        if(reg == CMD_CTRL && (val & CTRL_START) && _backend)
+            _backend->notify();
     }
 
     word_t *ep_regs() {
@@ -174,6 +294,9 @@ public:
     void set_ep(int i, size_t reg, word_t val) {
         _epregs[i * EPS_RCNT + reg] = val;
     }
+    word_t get_group(int i, size_t member, size_t reg) const {
+        return _epregs[GROUPS_START + i * GROUPS_RCNT + member * GRP_RCNT + reg];
+    }
 
     static DTU &get() {
         return inst;
@@ -188,9 +311,28 @@ public:
         eps[i * EPS_RCNT + EP_EPID] = epid;
         eps[i * EPS_RCNT + EP_CREDITS] = credits;
     }
+    /**
+     * Sets member <member> of the group registers <grp> of one endpoint.
+     */
+    static void configure_group(word_t *grp, size_t member, label_t label, int coreid, int epid) {
+        grp[member * GRP_RCNT + GRP_LABEL] = label;
+        grp[member * GRP_RCNT + GRP_COREID] = coreid;
+        grp[member * GRP_RCNT + GRP_EPID] = epid;
+    }
 
     void configure_recv(int ep, uintptr_t buf, uint order, uint msgorder, int flags);
 
+    /**
+     * Lets the DTU access the DRAM directly instead of sending messages to the kernel, which owns
+     * it. The DRAM is mapped at <addr> in this process and at <base> in the kernel, which is the
+     * address that memory capabilities refer to.
+     */
+    void set_dram(uintptr_t base, void *addr, size_t size) {
+        _dram_base = base;
+        _dram_size = size;
+        _dram = static_cast<char*>(addr);
+    }
+
     void send(int ep, const void *msg, size_t size, label_t replylbl, int replyep) {
         fire(ep, SEND, msg, size, 0, 0, replylbl, replyep);
     }
@@ -206,6 +348,18 @@ public:
     void cmpxchg(int ep, const void *msg, size_t msgsize, size_t off, size_t size) {
         fire(ep, CMPXCHG, msg, msgsize, off, size, label_t(), 0);
     }
+    void atomic(int ep, int op, word_t *val, size_t off) {
+        fire(ep, op, val, sizeof(word_t), off, sizeof(word_t), label_t(), 0);
+    }
+    void sendv(int ep, const IOVec *iov, size_t count, label_t replylbl, int replyep) {
+        firev(ep, SEND, iov, count, 0, 0, replylbl, replyep);
+    }
+    void readv(int ep, const IOVec *iov, size_t count, size_t off, size_t len) {
+        firev(ep, READ, iov, count, off, len, label_t(), 0);
+    }
+    void writev(int ep, const IOVec *iov, size_t count, size_t off, size_t len) {
+        firev(ep, WRITE, iov, count, off, len, label_t(), 0);
+    }
     void sendcrd(int ep, int crdep, size_t size) {
         set_cmd(CMD_EPID, ep);
         set_cmd(CMD_SIZE, size);
@@ -258,6 +412,70 @@ public:
             wait();
     }
 
+    /**
+     * Queues a READ, WRITE, REPLY or ACKMSG command without using the command registers. The DTU
+     * thread executes queued commands in order, but before the command in the registers. If all
+     * slots are in use, it waits until the oldest command is finished. In contrast to the command
+     * registers, the queue may be used by multiple threads concurrently.
+     *
+     * @return the token to wait for the completion of the command via wait_for_cmd()
+     */
+    word_t fire_async(int ep, int op, void *msg, size_t size, size_t offset, size_t len) {
+        assert(((uintptr_t)msg & (DTU_PKG_SIZE - 1)) == 0);
+        assert((size & (DTU_PKG_SIZE - 1)) == 0);
+        word_t token = __atomic_fetch_add(&_cmdq_next, 1, __ATOMIC_RELAXED);
+        Command &cmd = _cmdq[token % CMDQ_SIZE];
+        // the previous user of the slot has to be issued first; otherwise we might overwrite it.
+        // take the sequence before checking, so that we don't miss a change in between
+        uint32_t seq = _activity.load();
+        while(__atomic_load_n(&_cmdq_issued, __ATOMIC_ACQUIRE) + CMDQ_SIZE <= token ||
+                !is_finished(cmd.regs))
+            wait(seq);
+        cmd.token = token;
+        cmd.regs[CMD_ADDR] = reinterpret_cast<word_t>(msg);
+        cmd.regs[CMD_SIZE] = size;
+        cmd.regs[CMD_EPID] = ep;
+        cmd.regs[CMD_OFFSET] = offset;
+        cmd.regs[CMD_LENGTH] = len;
+        cmd.regs[CMD_REPLYLBL] = 0;
+        cmd.regs[CMD_REPLY_EPID] = 0;
+        // the DTU thread considers the slot only after START has been set
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        if(op == REPLY)
+            cmd.regs[CMD_CTRL] = (op << 3) | CTRL_START;
+        else
+            cmd.regs[CMD_CTRL] = (op << 3) | CTRL_START | CTRL_DEL_REPLY_CAP;
+        if(_backend)
+            _backend->notify();
+        return token;
+    }
+    word_t read_async(int ep, void *msg, size_t size, size_t off) {
+        return fire_async(ep, READ, msg, size, off, size);
+    }
+    word_t write_async(int ep, const void *msg, size_t size, size_t off) {
+        return fire_async(ep, WRITE, const_cast<void*>(msg), size, off, size);
+    }
+    word_t reply_async(int ep, const void *msg, size_t size, size_t msgidx) {
+        return fire_async(ep, REPLY, const_cast<void*>(msg), size, msgidx, 0);
+    }
+    word_t ack_message_async(int ep) {
+        return fire_async(ep, ACKMSG, nullptr, 0, 0, 0);
+    }
+    /**
+     * Waits until the queued command with given token is finished. If its slot has already been
+     * reused, the command is finished as well, but its result is unknown and true is returned.
+     *
+     * @return true if the command succeeded
+     */
+    bool wait_for_cmd(word_t token) {
+        const Command &cmd = _cmdq[token % CMDQ_SIZE];
+        // _waitseq belongs to the thread that uses wait(); other threads might call us as well
+        uint32_t seq = _activity.load();
+        while(cmd.token == token && !is_finished(cmd.regs))
+            wait(seq);
+        return cmd.token != token || (cmd.regs[CMD_CTRL] & CTRL_ERROR) == 0;
+    }
+
     void fire(int ep, int op, const void *msg, size_t size, size_t offset, size_t len,
             label_t replylbl, int replyep) {
         assert(((uintptr_t)msg & (DTU_PKG_SIZE - 1)) == 0);
@@ -275,41 +493,122 @@ public:
             set_cmd(CMD_CTRL, (op << 3) | CTRL_START | CTRL_DEL_REPLY_CAP);
     }
 
+    void firev(int ep, int op, const IOVec *iov, size_t count, size_t offset, size_t len,
+            label_t replylbl, int replyep) {
+        assert(len <= IOVec::total(iov, count));
+        set_cmd(CMD_ADDR, reinterpret_cast<word_t>(iov));
+        set_cmd(CMD_SIZE, count);
+        set_cmd(CMD_EPID, ep);
+        set_cmd(CMD_OFFSET, offset);
+        set_cmd(CMD_LENGTH, len);
+        set_cmd(CMD_REPLYLBL, replylbl);
+        set_cmd(CMD_REPLY_EPID, replyep);
+        set_cmd(CMD_CTRL, (op << 3) | CTRL_START | CTRL_DEL_REPLY_CAP | CTRL_IOVEC);
+    }
+
+    const Stats &stats() const {
+        return _stats;
+    }
+    void dump_stats();
+
     void start();
     void stop() {
         _run = false;
+        if(_backend)
+            _backend->notify();
     }
     pthread_t tid() const {
         return _tid;
     }
-    bool wait();
+    bool wait() {
+        return wait(_waitseq);
+    }
+    /**
+     * Like wait(), but uses <seq> to remember the DTU activity that has been seen. This allows
+     * multiple threads to wait for the DTU concurrently.
+     */
+    bool wait(uint32_t &seq);
 
 private:
-    int prepare_reply(int epid, int &dstcore, int &dstep);
-    int prepare_send(int epid, int &dstcore, int &dstep);
-    int prepare_read(int epid, int &dstcore, int &dstep);
-    int prepare_write(int epid, int &dstcore, int &dstep);
-    int prepare_cmpxchg(int epid, int &dstcore, int &dstep);
-    int prepare_sendcrd(int epid, int &dstcore, int &dstep);
+    // whether the DTU thread has something to do, apart from receiving messages
+    bool has_work() const {
+        const Command &next = _cmdq[_cmdq_issued % CMDQ_SIZE];
+        return !_run || _dump_stats || (get_cmd(CMD_CTRL) & CTRL_START) ||
+            (next.token == _cmdq_issued && (next.regs[CMD_CTRL] & CTRL_START));
+    }
+    // whether a memory command is finished, i.e., there is no response to wait for anymore
+    static bool is_finished(const volatile word_t *regs) {
+        return (regs[CMD_CTRL] & CTRL_START) == 0 &&
+            ((regs[CMD_CTRL] & CTRL_ERROR) || regs[CMD_SIZE] == 0);
+    }
+    static bool is_atomic(int op) {
+        return op >= FETCH_ADD && op <= FETCH_AND;
+    }
+    void wakeup_sw();
+    cycles_t &cmd_start(word_t token) {
+        return token == 0 ? _cmdstart : _cmdq[token % CMDQ_SIZE].start;
+    }
+    void finish_cmd(cycles_t start);
+
+    int prepare_reply(volatile word_t *cmd, int epid, int &dstcore, int &dstep);
+    int prepare_send(volatile word_t *cmd, int epid, int &dstcore, int &dstep);
+    int prepare_read(volatile word_t *cmd, word_t token, int epid, int &dstcore, int &dstep);
+    int prepare_write(volatile word_t *cmd, int epid, int &dstcore, int &dstep);
+    int prepare_cmpxchg(volatile word_t *cmd, word_t token, int epid, int &dstcore, int &dstep);
+    int prepare_atomic(volatile word_t *cmd, word_t token, int epid, int &dstcore, int &dstep);
+    int prepare_sendcrd(volatile word_t *cmd, int epid, int &dstcore, int &dstep);
     int prepare_ackmsg(int epid);
 
-    void send_msg(int epid, int dstcoreid, int dstepid, bool isreply);
+    void init_timing();
+    void delay_transfer(int dstcore, size_t bytes);
+
+    void send_msg(int epid, int dstcoreid, int dstepid, bool isreply,
+        const void *data = nullptr, size_t len = 0);
+    void send_multicast(int epid);
+    void send_data(int epid, int dstcoreid, int dstepid, bool isreply, word_t src, size_t iovcnt,
+        size_t pos, size_t len);
+    void send_write(volatile word_t *cmd, int epid, int dstcoreid, int dstepid);
     void handle_read_cmd(int epid);
     void handle_write_cmd(int epid);
     void handle_resp_cmd();
     void handle_cmpxchg_cmd(int epid);
-    void handle_command(int core);
-    void handle_receive(int i);
+    void handle_atomic_cmd(int epid, int op);
+    bool handle_dram_cmd(volatile word_t *cmd, int epid, int op, word_t &ctrl);
+    void handle_command(volatile word_t *cmd, word_t token, int core);
+    bool handle_queue(int core);
+    bool handle_receive(int i);
 
     static int check_cmd(int ep, int op, word_t addr, word_t credits, size_t offset, size_t length);
+    static Backend *create_backend();
+    static void sigquit(int);
     static void *thread(void *arg);
 
     volatile bool _run;
     volatile word_t _cmdregs[CMDS_RCNT];
+    cycles_t _cmdstart;
+    // the queued commands; slot i holds the command with token i (mod CMDQ_SIZE). token 0 denotes
+    // the command registers
+    struct Command {
+        volatile word_t regs[CMDS_RCNT];
+        volatile word_t token;
+        cycles_t start;
+    } _cmdq[CMDQ_SIZE];
+    word_t _cmdq_next;
+    word_t _cmdq_issued;
     // have to be aligned by 8 because it shouldn't collide with MemGate::RWX bits
-    alignas(8) volatile word_t _epregs[EPS_RCNT * EP_COUNT];
+    alignas(8) volatile word_t _epregs[ALL_EPS_RCNT];
     Backend *_backend;
     pthread_t _tid;
+    // increased by the DTU thread whenever it did something SW might be waiting for
+    std::atomic<uint32_t> _activity;
+    std::atomic<uint32_t> _waiters;
+    uint32_t _waitseq;
+    uintptr_t _dram_base;
+    size_t _dram_size;
+    char *_dram;
+    Stats _stats;
+    Timing _timing;
+    volatile bool _dump_stats;
     static Buffer _buf;
     static DTU inst;
 };
@@ -16,15 +16,19 @@
 
 #pragma once
 
+#include <m3/arch/host/SharedMemory.h>
 #include <m3/Config.h>
 #include <m3/DTU.h>
 
 #include <sys/un.h>
+#include <atomic>
 
 namespace m3 {
 
 class MsgBackend : public DTU::Backend {
     static constexpr int BASE_MSGQID        = 0x12340000;
+    // the default value of /proc/sys/kernel/msgmax
+    static constexpr size_t MAX_MSG_SIZE    = 8192;
 
 public:
     virtual void create() override;
@@ -32,6 +36,9 @@ public:
     virtual void reset() override;
     virtual void send(int core, int ep, const DTU::Buffer *buf) override;
     virtual ssize_t recv(int ep, DTU::Buffer *buf) override;
+    virtual size_t chunk_size() const override {
+        return MAX_MSG_SIZE - (DTU::HEADER_SIZE - sizeof(long));
+    }
 
 private:
     static key_t get_msgkey(int core, int rep) {
@@ -52,11 +59,169 @@ public:
     }
     virtual void send(int core, int ep, const DTU::Buffer *buf) override;
     virtual ssize_t recv(int ep, DTU::Buffer *buf) override;
+    virtual void sendv(int core, int ep, DTU::Buffer *buf, const void *data, size_t len) override;
+    virtual word_t fetch_pending() override;
+    virtual void wait() override;
+    virtual void notify() override;
 
 private:
+    void collect(int timeout);
+
     int _sock;
     int _localsocks[EP_COUNT];
     sockaddr_un _endpoints[MAX_CORES * EP_COUNT];
+    // the DTU thread blocks on all local sockets and on the eventfd for new commands
+    int _epoll;
+    int _cmdfd;
+    std::atomic<bool> _sleeping;
+    // the endpoints whose sockets are readable according to the last epoll_wait
+    word_t _ready;
+    bool _collected;
+};
+
+/**
+ * Transports messages via shared memory. There is one ring buffer for each endpoint on each core,
+ * which can be written by multiple senders and is read by the DTU thread of the receiving core.
+ * Thus, sending and receiving a message requires no system call, except for waking up the DTU
+ * thread of the receiver via futex, if it is sleeping.
+ */
+class ShmBackend : public DTU::Backend {
+    struct Ring;
+    struct Doorbell;
+
+public:
+    explicit ShmBackend();
+    virtual ~ShmBackend();
+
+    virtual void create() override;
+    virtual void destroy() override;
+    virtual void reset() override {
+    }
+    virtual void send(int core, int ep, const DTU::Buffer *buf) override;
+    virtual ssize_t recv(int ep, DTU::Buffer *buf) override;
+    virtual void sendv(int core, int ep, DTU::Buffer *buf, const void *data, size_t len) override;
+    virtual size_t chunk_size() const override;
+    virtual word_t fetch_pending() override;
+    virtual void wait() override;
+    virtual void notify() override;
+
+private:
+    void map(SharedMemory::Op op);
+    Ring *ring(int core, int ep) const;
+    Doorbell *doorbell(int core) const;
+    void ring_doorbell(int core);
+
+    SharedMemory *_shm;
+    uint32_t _lastseq;
+};
+
+/**
+ * The format of the files written by RecordBackend: a FileHeader, followed by a Record and the
+ * received bytes (header and payload) for every message.
+ */
+struct Recording {
+    static constexpr uint32_t MAGIC     = 0x5252334D;   // "M3RR"
+
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t core;
+        // the syscall endpoint, which is configured by the kernel during the recording
+        uint64_t sysc_label;
+        uint64_t sysc_epid;
+        uint64_t sysc_credits;
+    } PACKED;
+
+    struct Record {
+        // the logical time: the number of messages this core has sent before receiving this one
+        uint64_t time;
+        uint32_t ep;
+        uint32_t size;
+    } PACKED;
+};
+
+/**
+ * Passes everything to another backend, but appends every received message to a file. This is
+ * used if M3_DTU_RECORD is set to a directory, where one file per core and process is created.
+ */
+class RecordBackend : public DTU::Backend {
+public:
+    explicit RecordBackend(DTU::Backend *backend, const char *dir);
+    virtual ~RecordBackend();
+
+    virtual void create() override {
+        _backend->create();
+    }
+    virtual void destroy() override {
+        _backend->destroy();
+    }
+    virtual void reset() override {
+        _backend->reset();
+    }
+    virtual void send(int core, int ep, const DTU::Buffer *buf) override {
+        _sent++;
+        _backend->send(core, ep, buf);
+    }
+    virtual ssize_t recv(int ep, DTU::Buffer *buf) override;
+    virtual void sendv(int core, int ep, DTU::Buffer *buf, const void *data, size_t len) override {
+        _sent++;
+        _backend->sendv(core, ep, buf, data, len);
+    }
+    virtual size_t chunk_size() const override {
+        return _backend->chunk_size();
+    }
+    virtual word_t fetch_pending() override {
+        return _backend->fetch_pending();
+    }
+    virtual void wait() override {
+        _backend->wait();
+    }
+    virtual void notify() override {
+        _backend->notify();
+    }
+
+private:
+    DTU::Backend *_backend;
+    int _fd;
+    uint64_t _sent;
+};
+
+/**
+ * Feeds the messages of a file written by RecordBackend to this process, which is used if
+ * M3_DTU_REPLAY is set to that file. Sent messages are dropped. A message is delivered as soon as
+ * we have sent as many messages as before it has been received during the recording.
+ */
+class ReplayBackend : public DTU::Backend {
+public:
+    /**
+     * Reads the header of the given recording into <hd> or panics if that's not possible.
+     */
+    static void read_header(const char *file, Recording::FileHeader *hd);
+
+    explicit ReplayBackend(const char *file);
+    virtual ~ReplayBackend();
+
+    virtual void create() override {
+    }
+    virtual void destroy() override {
+    }
+    virtual void reset() override {
+    }
+    virtual void send(int, int, const DTU::Buffer *) override {
+        _sent++;
+    }
+    virtual ssize_t recv(int ep, DTU::Buffer *buf) override;
+    virtual void sendv(int, int, DTU::Buffer *, const void *, size_t) override {
+        _sent++;
+    }
+    virtual word_t fetch_pending() override;
+
+private:
+    bool next();
+
+    int _fd;
+    uint64_t _sent;
+    bool _valid;
+    Recording::Record _next;
 };
 
 }
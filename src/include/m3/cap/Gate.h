@@ -90,10 +90,30 @@ public:
         sel(newsel);
     }
 
+    /**
+     * Pins this gate to an endpoint, so that it is never removed from it to make room for other
+     * gates. Use that for gates that are used frequently, while many other gates exist.
+     *
+     * @return the error, if any
+     */
+    Errors::Code pin() {
+        return EPMux::get().pin(this);
+    }
+    /**
+     * Undoes pin(), i.e., allows the EPMux to remove it from the endpoint again.
+     */
+    void unpin() {
+        EPMux::get().unpin(this);
+    }
+
 protected:
     void ensure_activated() {
-        if(_epid == UNBOUND && sel() != Cap::INVALID)
-            EPMux::get().switch_to(this);
+        if(_epid == UNBOUND) {
+            if(sel() != Cap::INVALID)
+                EPMux::get().switch_to(this);
+        }
+        else
+            EPMux::get().touch(_epid);
     }
     void wait_until_sent() {
         DTU::get().wait_until_ready(_epid);
@@ -17,12 +17,14 @@
 #pragma once
 
 #include <m3/cap/Gate.h>
+#include <m3/IOVec.h>
 #include <m3/tracing/Tracing.h>
 
 namespace m3 {
 
 /**
- * A memory gate is a gate that allows the operations read, write and cmpxchg. Like the SendGate,
+ * A memory gate is a gate that allows the operations read, write, cmpxchg and (on the host) the
+ * atomic operations fetch_add, swap, fetch_or and fetch_and. Like the SendGate,
  * it is backed by a capability. In this case, it should be a memory-capability (otherwise
  * operations will fail).
  * For read and cmpxchg there is no asynchronously send reply, but they block until they are
@@ -121,6 +123,59 @@ public:
      */
     void read_sync(void *data, size_t len, size_t offset);
 
+    /**
+     * Performs a write-operation that gathers the data from the <count> parts at <iov> and writes
+     * them consecutively to <offset>. On the host, this is done with a single DTU command.
+     *
+     * @param iov the parts of the data
+     * @param count the number of parts
+     * @param offset the start-offset
+     */
+    void writev(const IOVec *iov, size_t count, size_t offset);
+
+    /**
+     * Performs a read-operation that reads the data at <offset> and scatters it into the <count>
+     * parts at <iov>. On the host, this is done with a single DTU command.
+     *
+     * @param iov the parts to read into
+     * @param count the number of parts
+     * @param offset the start-offset
+     */
+    void readv(const IOVec *iov, size_t count, size_t offset);
+
+    /**
+     * Starts to read <len> bytes from <offset> into <data> without waiting for the data. That is,
+     * <data> may not be accessed until wait() has been called with the returned token.
+     * Several transfers can be in flight at once; if the DTU can't queue further commands, it
+     * blocks until the oldest one is finished. Note that targets without a command queue perform
+     * the transfer synchronously.
+     *
+     * @param data the buffer to write into
+     * @param len the number of bytes to read
+     * @param offset the start-offset
+     * @return the token to pass to wait()
+     */
+    word_t read_async(void *data, size_t len, size_t offset);
+
+    /**
+     * Starts to write the <len> bytes at <data> to <offset>. <data> may not be changed until
+     * wait() has been called with the returned token.
+     *
+     * @param data the data to write
+     * @param len the number of bytes to write
+     * @param offset the start-offset
+     * @return the token to pass to wait()
+     */
+    word_t write_async(const void *data, size_t len, size_t offset);
+
+    /**
+     * Waits until the transfer with given token, started by read_async or write_async, is finished.
+     *
+     * @param token the token
+     * @return true on success
+     */
+    bool wait(word_t token);
+
 #if defined(__host__)
     /**
      * Performs the cmpxchg-operation. The first <len>/2 bytes at <data> are compared against the
@@ -134,6 +189,54 @@ public:
      * @return true on success
      */
     bool cmpxchg_sync(void *data, size_t len, size_t offset);
+
+    /**
+     * Atomically adds <val> to the word at <offset>, which has to be word-aligned. This requires
+     * read and write permission.
+     *
+     * @param val the value to add
+     * @param offset the offset of the word
+     * @return the previous value of the word
+     */
+    word_t fetch_add(word_t val, size_t offset) {
+        return atomic_op(DTU::FETCH_ADD, val, offset);
+    }
+
+    /**
+     * Atomically replaces the word at <offset> with <val>.
+     *
+     * @param val the new value
+     * @param offset the offset of the word
+     * @return the previous value of the word
+     */
+    word_t swap(word_t val, size_t offset) {
+        return atomic_op(DTU::SWAP, val, offset);
+    }
+
+    /**
+     * Atomically ORs <val> into the word at <offset>.
+     *
+     * @param val the bits to set
+     * @param offset the offset of the word
+     * @return the previous value of the word
+     */
+    word_t fetch_or(word_t val, size_t offset) {
+        return atomic_op(DTU::FETCH_OR, val, offset);
+    }
+
+    /**
+     * Atomically ANDs <val> into the word at <offset>.
+     *
+     * @param val the bits to keep
+     * @param offset the offset of the word
+     * @return the previous value of the word
+     */
+    word_t fetch_and(word_t val, size_t offset) {
+        return atomic_op(DTU::FETCH_AND, val, offset);
+    }
+
+private:
+    word_t atomic_op(int op, word_t val, size_t offset);
 #endif
 };
 
@@ -19,6 +19,7 @@
 #include <m3/cap/Gate.h>
 #include <m3/cap/RecvGate.h>
 #include <m3/Errors.h>
+#include <m3/IOVec.h>
 
 namespace m3 {
 
@@ -69,6 +70,21 @@ public:
     static SendGate create_for(const VPE &vpe, size_t dstep, label_t label = 0,
         word_t credits = UNLIMITED, RecvGate *rcvgate = nullptr, capsel_t sel = INVALID);
 
+    /**
+     * Creates a multicast gate. That is, a message sent over it is delivered to the destinations
+     * of all <count> send-gates at <members>, which need to have unlimited credits. The sender
+     * only issues a single command, independent of the number of members. Later changes to the
+     * members (e.g., revoking them) don't affect the multicast gate. This is only supported on
+     * the host; otherwise, Errors::last is set to Errors::NOT_SUP.
+     *
+     * @param members the selectors of the send-gates
+     * @param count the number of members (at most 16)
+     * @param rcvgate the receive-gate to which the replies should be sent
+     * @param sel the selector to use (if != INVALID, the selector is NOT freed on destruction)
+     */
+    static SendGate create_multicast(const capsel_t *members, size_t count,
+        RecvGate *rcvgate = nullptr, capsel_t sel = INVALID);
+
     /**
      * Binds this gate for sending to the given msg-capability. Typically, you've received the
      * cap from somebody else.
@@ -116,6 +132,15 @@ public:
         async_cmd(SEND, const_cast<void*>(data), len, 0, 0, _rcvgate->label(), _rcvgate->epid());
     }
 
+    /**
+     * Sends one message that consists of the <count> parts at <iov>, without assembling them in a
+     * contiguous buffer first. Like send_sync, it waits until the data has been sent.
+     *
+     * @param iov the parts of the message
+     * @param count the number of parts
+     */
+    void sendv(const IOVec *iov, size_t count);
+
 private:
     RecvGate *_rcvgate;
 };
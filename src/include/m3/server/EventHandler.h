@@ -47,11 +47,41 @@ class EventHandler : public Handler<EventSessionData> {
     friend class Server;
 
 public:
+    explicit EventHandler() : Handler<EventSessionData>(), _mcast(), _mcast_dirty(true) {
+    }
+    virtual ~EventHandler() {
+        delete _mcast;
+    }
+
     template<typename... Args>
     void broadcast(const Args &... args) {
         auto msg = create_vmsg(args...);
-        for(auto &h : *this)
-            msg.send(*static_cast<SendGate*>(h.gate()));
+        broadcast_msg(msg.bytes(), msg.total());
+    }
+
+    /**
+     * Sends the given message to all sessions that have delegated a gate to us. If possible, a
+     * multicast gate is used, so that it costs only a single send, regardless of the number of
+     * sessions.
+     *
+     * @param data the message
+     * @param len the length of the message
+     */
+    void broadcast_msg(const void *data, size_t len) {
+        SendGate *mcast = multicast_gate();
+        if(mcast)
+            mcast->send_sync(data, len);
+        else {
+            for(auto &h : *this) {
+                if(h.gate())
+                    h.gate()->send_sync(data, len);
+            }
+        }
+    }
+
+    virtual void remove_session(EventSessionData *sess) override {
+        Handler<EventSessionData>::remove_session(sess);
+        invalidate_multicast();
     }
 
 protected:
@@ -63,13 +93,50 @@ protected:
         }
 
         sess->_sgate = new SendGate(SendGate::bind(VPE::self().alloc_cap(), 0));
+        invalidate_multicast();
         reply_vmsg_on(args, Errors::NO_ERROR, CapRngDesc(sess->gate()->sel()));
     }
 
 private:
+    SendGate *multicast_gate() {
+#if defined(__host__)
+        // build the multicast gate once after the sessions changed; if that fails, we stay with
+        // individual sends until the next change
+        if(_mcast_dirty) {
+            _mcast_dirty = false;
+            capsel_t members[DTU::GROUP_MAX_MEMBERS];
+            size_t count = 0;
+            for(auto &h : *this) {
+                if(h.gate()) {
+                    if(count == DTU::GROUP_MAX_MEMBERS)
+                        return nullptr;
+                    members[count++] = h.gate()->sel();
+                }
+            }
+            if(count == 0)
+                return nullptr;
+
+            _mcast = new SendGate(SendGate::create_multicast(members, count));
+            if(Errors::last != Errors::NO_ERROR) {
+                delete _mcast;
+                _mcast = nullptr;
+            }
+        }
+#endif
+        return _mcast;
+    }
+    void invalidate_multicast() {
+        delete _mcast;
+        _mcast = nullptr;
+        _mcast_dirty = true;
+    }
+
     virtual size_t credits() {
         return SendGate::UNLIMITED;
     }
+
+    SendGate *_mcast;
+    bool _mcast_dirty;
 };
 
 }
@@ -50,7 +50,7 @@ public:
           _epid(VPE::self().alloc_ep()),
           _rcvbuf(RecvBuf::create(_epid, buford, msgord, 0)),
           _ctrl_rgate(RecvGate::create(&_rcvbuf)),
-          _ctrl_sgate(SendGate::create(DEF_MSGSIZE, &_ctrl_rgate)) {
+          _ctrl_sgate(SendGate::create(1UL << msgord, &_ctrl_rgate)) {
         Syscalls::get().createsrv(_ctrl_sgate.sel(), sel(), name);
 
         using std::placeholders::_1;
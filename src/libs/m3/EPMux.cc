@@ -21,14 +21,13 @@
 #include <m3/Syscalls.h>
 #include <m3/Errors.h>
 #include <m3/Log.h>
-#include <c/div.h>
 
 namespace m3 {
 
 EPMux EPMux::_inst INIT_PRIORITY(103);
 
 EPMux::EPMux()
-    : _next_victim(1), _epsw(new EPSwitcher), _gates() {
+    : _tick(), _activations(), _epsw(new EPSwitcher), _gates(), _lastuse(), _pinned() {
 }
 
 void EPSwitcher::switch_ep(size_t victim, capsel_t oldcap, capsel_t newcap) {
@@ -50,6 +49,7 @@ void EPMux::reserve(size_t ep) {
         }
         _gates[ep] = nullptr;
     }
+    _pinned[ep] = false;
 }
 
 void EPMux::switch_to(Gate *gate) {
@@ -57,6 +57,32 @@ void EPMux::switch_to(Gate *gate) {
     _epsw->switch_ep(victim, _gates[victim] ? _gates[victim]->sel() : Cap::INVALID, gate->sel());
     _gates[victim] = gate;
     gate->_epid = victim;
+    _activations++;
+    touch(victim);
+}
+
+Errors::Code EPMux::pin(Gate *gate) {
+    if(gate->sel() == Cap::INVALID)
+        return Errors::INV_ARGS;
+    // gates on reserved endpoints are never switched anyway
+    if(gate->_epid != Gate::UNBOUND && !VPE::self().is_ep_free(gate->_epid))
+        return Errors::NO_ERROR;
+    if(gate->_epid != Gate::UNBOUND && _pinned[gate->_epid])
+        return Errors::NO_ERROR;
+
+    // keep at least one endpoint for all other gates
+    if(multiplexable() <= 1)
+        return Errors::NO_SPACE;
+
+    if(gate->_epid == Gate::UNBOUND)
+        switch_to(gate);
+    _pinned[gate->_epid] = true;
+    return Errors::NO_ERROR;
+}
+
+void EPMux::unpin(Gate *gate) {
+    if(gate->_epid != Gate::UNBOUND && gate->_epid != Gate::NODESTROY)
+        _pinned[gate->_epid] = false;
 }
 
 void EPMux::switch_cap(Gate *gate, capsel_t newcap) {
@@ -81,6 +107,7 @@ void EPMux::remove(Gate *gate, bool invalidate) {
             _epsw->switch_ep(gate->_epid, gate->sel(), Cap::INVALID);
         }
         _gates[gate->_epid] = nullptr;
+        _pinned[gate->_epid] = false;
         gate->_epid = Gate::UNBOUND;
     }
 }
@@ -90,27 +117,39 @@ void EPMux::reset() {
         if(_gates[i])
             _gates[i]->_epid = Gate::UNBOUND;
         _gates[i] = nullptr;
+        _lastuse[i] = 0;
+        _pinned[i] = false;
     }
+    _tick = 0;
+    _activations = 0;
 }
 
-size_t EPMux::select_victim() {
+size_t EPMux::multiplexable() const {
     size_t count = 0;
-    size_t victim = _next_victim;
-    while(!VPE::self().is_ep_free(victim) && count++ < EP_COUNT) {
-        // victim = (victim + 1) % EP_COUNT
-        long rem;
-        divide(victim + 1, EP_COUNT, &rem);
-        victim = rem;
+    for(size_t i = 0; i < EP_COUNT; ++i) {
+        if(VPE::self().is_ep_free(i) && !_pinned[i])
+            count++;
     }
-    if(!VPE::self().is_ep_free(victim))
+    return count;
+}
+
+size_t EPMux::select_victim() {
+    // prefer an unused endpoint; otherwise take the least recently used one
+    size_t victim = EP_COUNT;
+    for(size_t i = 0; i < EP_COUNT; ++i) {
+        if(!VPE::self().is_ep_free(i) || _pinned[i])
+            continue;
+        if(_gates[i] == nullptr) {
+            victim = i;
+            break;
+        }
+        if(victim == EP_COUNT || _lastuse[i] < _lastuse[victim])
+            victim = i;
+    }
+    if(victim == EP_COUNT)
         PANIC("No free endpoints for multiplexing");
     if(_gates[victim] != nullptr)
         _gates[victim]->_epid = Gate::UNBOUND;
-
-    // _next_victim = (victim + 1) % EP_COUNT
-    long rem;
-    divide(victim + 1, EP_COUNT, &rem);
-    _next_victim = rem;
     return victim;
 }
 
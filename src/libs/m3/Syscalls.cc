@@ -24,6 +24,39 @@ namespace m3 {
 
 Syscalls Syscalls::_inst INIT_PRIORITY(108);
 
+static const char *opnames[] = {
+    "createsrv",
+    "createsess",
+    "creategate",
+    "createmcast",
+    "createvpe",
+    "attachrb",
+    "detachrb",
+    "exchange",
+    "vpectrl",
+    "delegate",
+    "obtain",
+    "activate",
+    "reqmem",
+    "derivemem",
+    "revoke",
+    "exit",
+    "noop",
+    "batch",
+    "syscstat",
+#if defined(__host__)
+    "init",
+#endif
+};
+
+static_assert(ARRAY_SIZE(opnames) == Syscalls::COUNT, "Syscall names are incomplete");
+
+const char *Syscalls::to_string(Operation op) {
+    if(static_cast<size_t>(op) < ARRAY_SIZE(opnames))
+        return opnames[op];
+    return "unknown";
+}
+
 Errors::Code Syscalls::finish(GateIStream &&reply) {
     reply >> Errors::last;
     return Errors::last;
@@ -57,6 +90,16 @@ Errors::Code Syscalls::creategate(capsel_t vpe, capsel_t dst, label_t label, siz
     return finish(send_receive_vmsg(_gate, CREATEGATE, vpe, dst, label, ep, credits));
 }
 
+Errors::Code Syscalls::createmcast(capsel_t dst, const capsel_t *members, size_t count) {
+    LOG(SYSC, "createmcast(dst=" << dst << ", members=" << count << ")");
+    AutoGateOStream msg(vostreamsize(ostreamsize<Operation, capsel_t, size_t>(),
+        count * ostreamsize<capsel_t>()));
+    msg << CREATEMCAST << dst << count;
+    for(size_t i = 0; i < count; ++i)
+        msg << members[i];
+    return finish(send_receive_msg(_gate, msg.bytes(), msg.total()));
+}
+
 Errors::Code Syscalls::createvpe(capsel_t vpe, capsel_t mem, const String &name, const String &core) {
     LOG(SYSC, "createvpe(vpe=" << vpe << ", mem=" << mem << ", name=" << name << ", core=" << core << ")");
     return finish(send_receive_vmsg(_gate, CREATEVPE, vpe, mem, name, core));
@@ -125,9 +168,13 @@ Errors::Code Syscalls::derivemem(capsel_t src, capsel_t dst, size_t offset, size
     return finish(send_receive_vmsg(_gate, DERIVEMEM, src, dst, offset, size, perms));
 }
 
-Errors::Code Syscalls::revoke(const CapRngDesc &crd) {
+Errors::Code Syscalls::revoke(const CapRngDesc &crd, size_t *removed) {
     LOG(SYSC, "revoke(crd=" << crd << ")");
-    return finish(send_receive_vmsg(_gate, REVOKE, crd));
+    GateIStream &&reply = send_receive_vmsg(_gate, REVOKE, crd);
+    reply >> Errors::last;
+    if(removed && Errors::last == Errors::NO_ERROR)
+        reply >> *removed;
+    return Errors::last;
 }
 
 void Syscalls::exit(int exitcode) {
@@ -136,11 +183,98 @@ void Syscalls::exit(int exitcode) {
     return send_vmsg(_gate, EXIT, exitcode);
 }
 
+template<typename... Args>
+bool Syscalls::Batch::add(Operation op, const Args &... args) {
+    if(_count == 0)
+        _os << BATCH << _count;
+    if(_os.total() + ostreamsize<Operation, Args...>() > sizeof(_bytes))
+        return false;
+    _os << op;
+    _os.vput(args...);
+    _count++;
+    return true;
+}
+
+bool Syscalls::Batch::creategate(capsel_t vpe, capsel_t dst, label_t label, size_t ep, word_t credits) {
+    return add(CREATEGATE, vpe, dst, label, ep, credits);
+}
+
+bool Syscalls::Batch::attachrb(capsel_t vpe, size_t ep, uintptr_t addr, int order, int msgorder, uint flags) {
+    return add(ATTACHRB, vpe, ep, addr, order, msgorder, flags);
+}
+
+bool Syscalls::Batch::detachrb(capsel_t vpe, size_t ep) {
+    return add(DETACHRB, vpe, ep);
+}
+
+bool Syscalls::Batch::exchange(capsel_t vpe, const CapRngDesc &own, const CapRngDesc &other, bool obtain) {
+    return add(EXCHANGE, vpe, own, other, obtain);
+}
+
+bool Syscalls::Batch::reqmemat(capsel_t cap, uintptr_t addr, size_t size, int perms) {
+    return add(REQMEM, cap, addr, size, perms);
+}
+
+bool Syscalls::Batch::derivemem(capsel_t src, capsel_t dst, size_t offset, size_t size, int perms) {
+    return add(DERIVEMEM, src, dst, offset, size, perms);
+}
+
+bool Syscalls::Batch::revoke(const CapRngDesc &crd) {
+    return add(REVOKE, crd);
+}
+
+Errors::Code Syscalls::batch(Batch &batch) {
+    LOG(SYSC, "batch(count=" << batch.count() << ")");
+    if(batch.count() == 0)
+        return Errors::last = Errors::NO_ERROR;
+
+    // the count at the beginning has been reserved by the first add
+    Marshaller hd(batch._bytes, ostreamsize<Operation, size_t>());
+    hd << BATCH << batch.count();
+    GateIStream reply = send_receive_msg(_gate, batch._bytes, batch._os.total());
+    reply >> Errors::last >> batch._executed;
+    batch._error = Errors::last;
+    return Errors::last;
+}
+
+Errors::Code Syscalls::syscstat(Operation op, Stat &stat) {
+    LOG(SYSC, "syscstat(op=" << op << ")");
+    // the histogram does not fit into the reply slots of the default receive buffer. thus, the
+    // kernel takes a snapshot with the first request and returns the rest of it with the others
+    for(size_t i = 0; i < STAT_BUCKETS; i += STAT_BUCKETS_PER_MSG) {
+        GateIStream reply = send_receive_vmsg(_gate, SYSCSTAT, op, i);
+        reply >> Errors::last;
+        if(Errors::last != Errors::NO_ERROR)
+            return Errors::last;
+        reply >> stat.calls >> stat.errors >> stat.cycles;
+        for(size_t j = 0; j < STAT_BUCKETS_PER_MSG; ++j)
+            reply >> stat.hist[i + j];
+        // without any calls, the remaining buckets are empty anyway
+        if(stat.calls == 0) {
+            for(size_t j = i + STAT_BUCKETS_PER_MSG; j < STAT_BUCKETS; ++j)
+                stat.hist[j] = 0;
+            break;
+        }
+    }
+    return Errors::last;
+}
+
 #if defined(__host__)
 void Syscalls::init(void *sepregs) {
     LOG(SYSC, "init(addr=" << sepregs << ")");
     send_receive_vmsg(_gate, INIT, sepregs);
 }
+
+Errors::Code Syscalls::vpestart(capsel_t vpe, int pid, Config::Params &params) {
+    LOG(SYSC, "vpectrl(vpe=" << vpe << ", op=" << VCTRL_START << ", pid=" << pid << ")");
+    GateIStream &&reply = send_receive_vmsg(_gate, VPECTRL, vpe, VCTRL_START, pid);
+    reply >> Errors::last;
+    if(Errors::last == Errors::NO_ERROR) {
+        reply >> params.core >> params.sysc_label >> params.sysc_epid >> params.sysc_credits;
+        Config::get().shared_params(params);
+    }
+    return Errors::last;
+}
 #endif
 
 }
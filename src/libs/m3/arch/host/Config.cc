@@ -15,6 +15,7 @@
  */
 
 #include <m3/arch/host/Backtrace.h>
+#include <m3/arch/host/DTUBackend.h>
 #include <m3/cap/RecvGate.h>
 #include <m3/Config.h>
 #include <m3/Syscalls.h>
@@ -23,13 +24,13 @@
 
 #include <sys/types.h>
 #include <sys/ipc.h>
+#include <sys/mman.h>
 #include <sys/sem.h>
 #include <sys/time.h>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <pthread.h>
-#include <fstream>
-#include <iostream>
 #include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -90,8 +91,8 @@ Config::Init::~Init() {
     delete _inst;
 }
 
-void Config::reset() {
-    set_params(this, nullptr, false);
+void Config::reset(int fd) {
+    set_params(this, nullptr, false, fd);
     Serial::init(executable(), coreid());
 
     DTU::get().reset();
@@ -104,8 +105,8 @@ void Config::reset() {
 }
 
 Config::Config()
-        : _core(), _logfd(-1), _shm_prefix(), _is_kernel(set_params(this, nullptr, false)),
-          _log_mutex(PTHREAD_MUTEX_INITIALIZER),
+        : _core(), _logfd(-1), _shm_prefix(), _dram_fd(-1), _dram_base(),
+          _is_kernel(set_params(this, nullptr, false, -1)), _dram(), _log_mutex(PTHREAD_MUTEX_INITIALIZER),
           // the memory receive buffer is required to let others access our memory via DTU
           _mem_recvbuf(RecvBuf::bindto(DTU::MEM_EP, 0, sizeof(word_t) * 8 - 1,
                            RecvBuf::NO_HEADER | RecvBuf::NO_RINGBUF)),
@@ -116,8 +117,8 @@ Config::Config()
 }
 
 Config::Config(int core, const char *shmprefix)
-        : _core(core), _logfd(-1), _shm_prefix(), _is_kernel(set_params(this, shmprefix, true)),
-          _log_mutex(PTHREAD_MUTEX_INITIALIZER),
+        : _core(core), _logfd(-1), _shm_prefix(), _dram_fd(-1), _dram_base(),
+          _is_kernel(set_params(this, shmprefix, true, -1)), _dram(), _log_mutex(PTHREAD_MUTEX_INITIALIZER),
           _mem_recvbuf(RecvBuf::bindto(DTU::MEM_EP, 0, sizeof(word_t) * 8 - 1,
                            RecvBuf::NO_HEADER | RecvBuf::NO_RINGBUF)),
           _def_recvbuf(RecvBuf::create(DTU::DEF_RECVEP, nextlog2<256>::val, nextlog2<128>::val, 0)),
@@ -153,22 +154,72 @@ void Config::init_dtu() {
 
     DTU::get().configure(DTU::SYSC_EP, _sysc_label, 0, _sysc_epid, _sysc_credits);
 
+    // the DRAM is shared between the kernel and all VPEs, so that the DTU can access it directly.
+    // the kernel maps it on its own and we keep the mapping if we've been forked. if we replay
+    // a recording, there is no DRAM to map.
+    if(!_is_kernel && _dram == nullptr && _dram_fd != -1) {
+        _dram = mmap(0, DRAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, _dram_fd, 0);
+        if(_dram == MAP_FAILED)
+            PANIC("Unable to map DRAM: " << strerror(errno));
+        DTU::get().set_dram(_dram_base, _dram, DRAM_SIZE);
+    }
+
     DTU::get().start();
 }
 
-bool Config::set_params(Config *env, const char *shm_prefix, bool is_kernel) {
-    if(!is_kernel) {
-        char path[64];
-        snprintf(path, sizeof(path), "/tmp/m3/%d", getpid());
-        std::ifstream in(path);
-        if(!in.good())
-            PANIC("Unable to read " << path);
-        label_t lbl;
-        std::string shm_prefix;
-        in >> shm_prefix >> env->_core >> lbl >> env->_sysc_epid;
-        in >> env->_sysc_credits;
-        env->_shm_prefix = String(shm_prefix.c_str());
-        env->_sysc_label = lbl;
+void Config::shared_params(Params &p) const {
+    strncpy(p.shm_prefix, _shm_prefix.c_str(), sizeof(p.shm_prefix));
+    p.shm_prefix[sizeof(p.shm_prefix) - 1] = '\0';
+    p.dram_fd = _dram_fd;
+    p.dram_base = _dram_base;
+}
+
+bool Config::set_params(Config *env, const char *shm_prefix, bool is_kernel, int fd) {
+    const char *replay = getenv("M3_DTU_REPLAY");
+    if(!is_kernel && replay) {
+        // we run standalone and get everything from the recording instead of the kernel
+        Recording::FileHeader hd;
+        ReplayBackend::read_header(replay, &hd);
+        env->_shm_prefix = String("");
+        env->_core = hd.core;
+        env->_sysc_label = hd.sysc_label;
+        env->_sysc_epid = hd.sysc_epid;
+        env->_sysc_credits = hd.sysc_credits;
+        env->_dram_fd = -1;
+        env->_logfd = open("run/log.txt", O_WRONLY | O_APPEND);
+    }
+    else if(!is_kernel) {
+        // if we have been started by the kernel, the pipe contains only the parameters. if we have
+        // been started via VPE::run or VPE::exec, VPE::init_state has already read the state in
+        // front of them.
+        if(fd == -1) {
+            const char *envfd = getenv("M3_ENV_FD");
+            if(!envfd)
+                envfd = getenv("M3_STATE_FD");
+            if(!envfd)
+                PANIC("No startup parameters given");
+            fd = atoi(envfd);
+            unsetenv("M3_ENV_FD");
+            unsetenv("M3_STATE_FD");
+        }
+
+        Params p;
+        char *buf = reinterpret_cast<char*>(&p);
+        for(size_t pos = 0; pos < sizeof(p); ) {
+            ssize_t res = read(fd, buf + pos, sizeof(p) - pos);
+            if(res <= 0)
+                PANIC("Reading startup parameters failed: " << strerror(errno));
+            pos += res;
+        }
+        close(fd);
+
+        env->_shm_prefix = String(p.shm_prefix);
+        env->_core = p.core;
+        env->_sysc_label = p.sysc_label;
+        env->_sysc_epid = p.sysc_epid;
+        env->_sysc_credits = p.sysc_credits;
+        env->_dram_fd = p.dram_fd;
+        env->_dram_base = p.dram_base;
         env->_logfd = open("run/log.txt", O_WRONLY | O_APPEND);
     }
     else {
@@ -17,12 +17,19 @@
 #include <m3/arch/host/HWInterrupts.h>
 #include <m3/arch/host/DTUBackend.h>
 #include <m3/cap/MemGate.h>
+#include <m3/util/Profile.h>
 #include <m3/Log.h>
 #include <m3/DTU.h>
 #include <m3/Config.h>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <climits>
 #include <sstream>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <time.h>
 
 namespace m3 {
 
@@ -41,37 +48,182 @@ static void dumpBytes(uint8_t *bytes, size_t length) {
         LOG(DTUERR, "  " << tmp.str().c_str());
 }
 
+// number of IOVecs at CMD_ADDR or 0 if it points to the data itself
+static size_t cmd_iovcnt(const volatile word_t *cmd) {
+    return (cmd[DTU::CMD_CTRL] & DTU::CTRL_IOVEC) ? cmd[DTU::CMD_SIZE] : 0;
+}
+
+// the number of bytes at CMD_ADDR
+static size_t cmd_size(const volatile word_t *cmd) {
+    if(cmd[DTU::CMD_CTRL] & DTU::CTRL_IOVEC)
+        return IOVec::total(reinterpret_cast<const IOVec*>(cmd[DTU::CMD_ADDR]), cmd[DTU::CMD_SIZE]);
+    return cmd[DTU::CMD_SIZE];
+}
+
+// copies <len> bytes, starting at <off>, from <src>, which points to <iovcnt> IOVecs, if non-zero
+static void gather(char *dst, word_t src, size_t iovcnt, size_t off, size_t len) {
+    if(iovcnt == 0) {
+        memcpy(dst, reinterpret_cast<const char*>(src) + off, len);
+        return;
+    }
+    const IOVec *iov = reinterpret_cast<const IOVec*>(src);
+    for(size_t i = 0; i < iovcnt && len > 0; ++i) {
+        if(off >= iov[i].len) {
+            off -= iov[i].len;
+            continue;
+        }
+        size_t amount = std::min(iov[i].len - off, len);
+        memcpy(dst, static_cast<const char*>(iov[i].base) + off, amount);
+        dst += amount;
+        len -= amount;
+        off = 0;
+    }
+}
+
+// the counterpart of gather: copies <len> bytes from <src> to <dst>, starting at <off>
+static void scatter(word_t dst, size_t iovcnt, size_t off, const char *src, size_t len) {
+    if(iovcnt == 0) {
+        memcpy(reinterpret_cast<char*>(dst) + off, src, len);
+        return;
+    }
+    const IOVec *iov = reinterpret_cast<const IOVec*>(dst);
+    for(size_t i = 0; i < iovcnt && len > 0; ++i) {
+        if(off >= iov[i].len) {
+            off -= iov[i].len;
+            continue;
+        }
+        size_t amount = std::min(iov[i].len - off, len);
+        memcpy(static_cast<char*>(iov[i].base) + off, src, amount);
+        src += amount;
+        len -= amount;
+        off = 0;
+    }
+}
+
 DTU DTU::inst INIT_PRIORITY(106);
 DTU::Buffer DTU::_buf INIT_PRIORITY(106);
 
-DTU::DTU() : _run(true), _cmdregs(), _epregs(), _tid() {
+DTU::DTU() : _run(true), _cmdregs(), _cmdstart(), _cmdq(), _cmdq_next(1), _cmdq_issued(1),
+        _epregs(), _backend(), _tid(), _activity(), _waiters(), _waitseq(), _dram_base(),
+        _dram_size(), _dram(), _stats(), _timing(), _dump_stats() {
+}
+
+DTU::Backend *DTU::create_backend() {
+    // the backend is chosen at runtime to be able to compare them without rebuilding everything
+    const char *name = getenv("M3_DTU_BACKEND");
+    if(name == nullptr || strcmp(name, "socket") == 0)
+        return new SocketBackend();
+    if(strcmp(name, "msgq") == 0)
+        return new MsgBackend();
+    if(strcmp(name, "shm") == 0)
+        return new ShmBackend();
+    PANIC("Unknown DTU backend '" << name << "' (expected socket, msgq or shm)");
+}
+
+static uint64_t env_value(const char *name) {
+    const char *val = getenv(name);
+    return val ? strtoull(val, nullptr, 0) : 0;
+}
+
+void DTU::init_timing() {
+    _timing.msg_ns = env_value("M3_DTU_LATENCY");
+    _timing.bandwidth = env_value("M3_DTU_BANDWIDTH");
+    _timing.hop_ns = env_value("M3_DTU_HOP_LATENCY");
+    _timing.enabled = _timing.msg_ns || _timing.bandwidth || _timing.hop_ns;
+}
+
+void DTU::delay_transfer(int dstcore, size_t bytes) {
+    const int src = coreid();
+    const int hops = abs(src % Timing::NOC_COLUMNS - dstcore % Timing::NOC_COLUMNS) +
+                     abs(src / Timing::NOC_COLUMNS - dstcore / Timing::NOC_COLUMNS);
+    uint64_t ns = _timing.msg_ns + hops * _timing.hop_ns;
+    // MB/s is the same as bytes per us
+    if(_timing.bandwidth)
+        ns += bytes * 1000 / _timing.bandwidth;
+    _stats.delay_ns += ns;
+
+    // the delays are far below the timer resolution of the OS, so that we have to spin. this
+    // keeps the DTU busy in the meantime, as on the hardware
+    timespec now, end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += ns / 1000000000;
+    end.tv_nsec += ns % 1000000000;
+    if(end.tv_nsec >= 1000000000) {
+        end.tv_sec++;
+        end.tv_nsec -= 1000000000;
+    }
+    do
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    while(now.tv_sec < end.tv_sec || (now.tv_sec == end.tv_sec && now.tv_nsec < end.tv_nsec));
+}
+
+void DTU::sigquit(int) {
+    // let the DTU thread print the statistics; we can't do that in a signal handler
+    inst._dump_stats = true;
+    if(inst._backend)
+        inst._backend->notify();
 }
 
 void DTU::start() {
-#if USE_MSGBACKEND
-    _backend = new MsgBackend();
-#else
-    _backend = new SocketBackend();
-#endif
+    const char *replay = getenv("M3_DTU_REPLAY");
+    const char *record = getenv("M3_DTU_RECORD");
+    if(replay) {
+        if(Config::get().is_kernel())
+            PANIC("The kernel can't be replayed");
+        _backend = new ReplayBackend(replay);
+    }
+    else if(record)
+        _backend = new RecordBackend(create_backend(), record);
+    else
+        _backend = create_backend();
+    // accesses to DRAM have to go through the backend to be recorded or replayed
+    if(replay || record)
+        _dram = nullptr;
+    init_timing();
+
     if(Config::get().is_kernel())
         _backend->create();
 
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = sigquit;
+    act.sa_flags = SA_RESTART;
+    sigaction(SIGQUIT, &act, nullptr);
+
     int res = pthread_create(&_tid, nullptr, thread, this);
     if(res != 0)
         PANIC("pthread_create");
 }
 
 void DTU::reset() {
-    memset(ep_regs(), 0, EPS_RCNT * EP_COUNT * sizeof(word_t));
+    memset(ep_regs(), 0, ALL_EPS_RCNT * sizeof(word_t));
+    memset(const_cast<Command*>(_cmdq), 0, sizeof(_cmdq));
+    _cmdq_next = _cmdq_issued = 1;
 
     _backend->reset();
 }
 
-bool DTU::wait() {
-    usleep(1);
+bool DTU::wait(uint32_t &seq) {
+    // sleep until the DTU thread did something. if that happened since the last time we woke up,
+    // we return immediately, because the caller might not have seen it yet. the timeout is just
+    // a safety net in case SW waits for something else than the DTU (signals interrupt us anyway).
+    timespec timeout = {0, 1000 * 1000};
+    _waiters.fetch_add(1);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_activity), FUTEX_WAIT_PRIVATE, seq,
+        &timeout, nullptr, 0);
+    _waiters.fetch_sub(1);
+    seq = _activity.load();
     return _run;
 }
 
+void DTU::wakeup_sw() {
+    _activity.fetch_add(1);
+    if(_waiters.load() > 0) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_activity), FUTEX_WAKE_PRIVATE, INT_MAX,
+            nullptr, nullptr, 0);
+    }
+}
+
 void DTU::configure_recv(int ep, uintptr_t buf, uint order, uint msgorder, int flags) {
     set_ep(ep, EP_BUF_ADDR, buf);
     set_ep(ep, EP_BUF_ORDER, order);
@@ -83,9 +235,11 @@ void DTU::configure_recv(int ep, uintptr_t buf, uint order, uint msgorder, int f
 }
 
 int DTU::check_cmd(int ep, int op, word_t label, word_t credits, size_t offset, size_t length) {
-    if(op == READ || op == WRITE || op == CMPXCHG) {
+    if(op == READ || op == WRITE || op == CMPXCHG || is_atomic(op)) {
         uint perms = label & MemGate::RWX;
-        if(!(perms & (1 << op))) {
+        // atomic operations read and write the word
+        uint required = is_atomic(op) ? (MemGate::R | MemGate::W) : (1U << op);
+        if((perms & required) != required) {
             LOG(DTUERR, "DMA-error: operation not permitted on ep " << ep << " (perms="
                     << perms << ", op=" << op << ")");
             return CTRL_ERROR;
@@ -99,10 +253,9 @@ int DTU::check_cmd(int ep, int op, word_t label, word_t credits, size_t offset,
     return 0;
 }
 
-int DTU::prepare_reply(int epid,int &dstcore,int &dstep) {
-    const void *src = reinterpret_cast<const void*>(get_cmd(CMD_ADDR));
-    const size_t size = get_cmd(CMD_SIZE);
-    const size_t reply = get_cmd(CMD_OFFSET);
+int DTU::prepare_reply(volatile word_t *cmd, int epid, int &dstcore, int &dstep) {
+    const size_t size = cmd_size(cmd);
+    const size_t reply = cmd[CMD_OFFSET];
 
     if(get_ep(epid, EP_BUF_FLAGS) & FLAG_NO_HEADER) {
         LOG(DTUERR, "DMA-error: want to reply, but header is disabled");
@@ -125,19 +278,19 @@ int DTU::prepare_reply(int epid,int &dstcore,int &dstep) {
     _buf.credits = buf->length + HEADER_SIZE;
     _buf.crd_ep = buf->snd_epid;
     _buf.length = size;
-    memcpy(_buf.data, src, size);
+    gather(_buf.data, cmd[CMD_ADDR], cmd_iovcnt(cmd), 0, size);
     // invalidate message for replying
     buf->has_replycap = false;
     return 0;
 }
 
-int DTU::prepare_send(int epid,int &dstcore,int &dstep) {
-    const void *src = reinterpret_cast<const void*>(get_cmd(CMD_ADDR));
+int DTU::prepare_send(volatile word_t *cmd, int epid, int &dstcore, int &dstep) {
     const word_t credits = get_ep(epid, EP_CREDITS);
-    const size_t size = get_cmd(CMD_SIZE);
+    const size_t size = cmd_size(cmd);
     // check if we have enough credits
     if(credits != static_cast<word_t>(-1)) {
         if(size + HEADER_SIZE > credits) {
+            _stats.eps[epid].credit_stalls++;
             LOG(DTUERR, "DMA-error: insufficient credits on ep " << epid
                     << " (have #" << fmt(credits, "x") << ", need #" << fmt(size + HEADER_SIZE, "x")
                     << ")." << " Ignoring send-command");
@@ -152,64 +305,90 @@ int DTU::prepare_send(int epid,int &dstcore,int &dstep) {
     _buf.label = get_ep(epid, EP_LABEL);
 
     _buf.length = size;
-    memcpy(_buf.data, src, size);
+    gather(_buf.data, cmd[CMD_ADDR], cmd_iovcnt(cmd), 0, size);
     return 0;
 }
 
-int DTU::prepare_read(int epid,int &dstcore,int &dstep) {
+int DTU::prepare_read(volatile word_t *cmd, word_t token, int epid, int &dstcore, int &dstep) {
     dstcore = get_ep(epid, EP_COREID);
     dstep = get_ep(epid, EP_EPID);
 
     _buf.credits = 0;
     _buf.label = get_ep(epid, EP_LABEL);
-    _buf.length = sizeof(word_t) * 3;
-    reinterpret_cast<word_t*>(_buf.data)[0] = get_cmd(CMD_OFFSET);
-    reinterpret_cast<word_t*>(_buf.data)[1] = get_cmd(CMD_LENGTH);
-    reinterpret_cast<word_t*>(_buf.data)[2] = get_cmd(CMD_ADDR);
+    _buf.length = sizeof(word_t) * 5;
+    reinterpret_cast<word_t*>(_buf.data)[0] = cmd[CMD_OFFSET];
+    reinterpret_cast<word_t*>(_buf.data)[1] = cmd[CMD_LENGTH];
+    reinterpret_cast<word_t*>(_buf.data)[2] = cmd[CMD_ADDR];
+    reinterpret_cast<word_t*>(_buf.data)[3] = token;
+    reinterpret_cast<word_t*>(_buf.data)[4] = cmd_iovcnt(cmd);
     return 0;
 }
 
-int DTU::prepare_write(int epid,int &dstcore,int &dstep) {
-    const void *src = reinterpret_cast<const void*>(get_cmd(CMD_ADDR));
-    const size_t size = get_cmd(CMD_SIZE);
+int DTU::prepare_write(volatile word_t *, int epid, int &dstcore, int &dstep) {
     dstcore = get_ep(epid, EP_COREID);
     dstep = get_ep(epid, EP_EPID);
 
+    // the data is sent by send_write
     _buf.credits = 0;
     _buf.label = get_ep(epid, EP_LABEL);
-    _buf.length = sizeof(word_t) * 2;
-    reinterpret_cast<word_t*>(_buf.data)[0] = get_cmd(CMD_OFFSET);
-    reinterpret_cast<word_t*>(_buf.data)[1] = get_cmd(CMD_LENGTH);
-    memcpy(_buf.data + _buf.length, src, size);
-    _buf.length += size;
     return 0;
 }
 
-int DTU::prepare_cmpxchg(int epid,int &dstcore,int &dstep) {
-    const void *src = reinterpret_cast<const void*>(get_cmd(CMD_ADDR));
-    const size_t size = get_cmd(CMD_SIZE);
+int DTU::prepare_cmpxchg(volatile word_t *cmd, word_t token, int epid, int &dstcore, int &dstep) {
+    const void *src = reinterpret_cast<const void*>(cmd[CMD_ADDR]);
+    const size_t size = cmd[CMD_SIZE];
     dstcore = get_ep(epid, EP_COREID);
     dstep = get_ep(epid, EP_EPID);
 
-    if(size != get_cmd(CMD_LENGTH) * 2) {
+    if(cmd[CMD_CTRL] & CTRL_IOVEC) {
+        LOG(DTUERR, "DMA-error: cmpxchg: IOVecs are not supported. Ignoring send-command");
+        return CTRL_ERROR;
+    }
+    if(size != cmd[CMD_LENGTH] * 2) {
         LOG(DTUERR, "DMA-error: cmpxchg: CMD_SIZE != CMD_LENGTH * 2. Ignoring send-command");
         return CTRL_ERROR;
     }
 
     _buf.credits = 0;
     _buf.label = get_ep(epid, EP_LABEL);
-    _buf.length = sizeof(word_t) * 3;
-    reinterpret_cast<word_t*>(_buf.data)[0] = get_cmd(CMD_OFFSET);
-    reinterpret_cast<word_t*>(_buf.data)[1] = get_cmd(CMD_LENGTH);
-    reinterpret_cast<word_t*>(_buf.data)[2] = get_cmd(CMD_ADDR);
+    _buf.length = sizeof(word_t) * 4;
+    reinterpret_cast<word_t*>(_buf.data)[0] = cmd[CMD_OFFSET];
+    reinterpret_cast<word_t*>(_buf.data)[1] = cmd[CMD_LENGTH];
+    reinterpret_cast<word_t*>(_buf.data)[2] = cmd[CMD_ADDR];
+    reinterpret_cast<word_t*>(_buf.data)[3] = token;
     memcpy(_buf.data + _buf.length, src, size);
     _buf.length += size;
     return 0;
 }
 
-int DTU::prepare_sendcrd(int epid, int &dstcore, int &dstep) {
-    const size_t size = get_cmd(CMD_SIZE);
-    const int crdep = get_cmd(CMD_OFFSET);
+int DTU::prepare_atomic(volatile word_t *cmd, word_t token, int epid, int &dstcore, int &dstep) {
+    dstcore = get_ep(epid, EP_COREID);
+    dstep = get_ep(epid, EP_EPID);
+
+    if(cmd[CMD_CTRL] & CTRL_IOVEC) {
+        LOG(DTUERR, "DMA-error: atomic: IOVecs are not supported. Ignoring send-command");
+        return CTRL_ERROR;
+    }
+    if(cmd[CMD_SIZE] != sizeof(word_t) || cmd[CMD_LENGTH] != sizeof(word_t) ||
+            (cmd[CMD_OFFSET] & (sizeof(word_t) - 1))) {
+        LOG(DTUERR, "DMA-error: atomic: only aligned words are supported. Ignoring send-command");
+        return CTRL_ERROR;
+    }
+
+    _buf.credits = 0;
+    _buf.label = get_ep(epid, EP_LABEL);
+    _buf.length = sizeof(word_t) * 5;
+    reinterpret_cast<word_t*>(_buf.data)[0] = cmd[CMD_OFFSET];
+    reinterpret_cast<word_t*>(_buf.data)[1] = cmd[CMD_LENGTH];
+    reinterpret_cast<word_t*>(_buf.data)[2] = cmd[CMD_ADDR];
+    reinterpret_cast<word_t*>(_buf.data)[3] = token;
+    reinterpret_cast<word_t*>(_buf.data)[4] = *reinterpret_cast<word_t*>(cmd[CMD_ADDR]);
+    return 0;
+}
+
+int DTU::prepare_sendcrd(volatile word_t *cmd, int epid, int &dstcore, int &dstep) {
+    const size_t size = cmd[CMD_SIZE];
+    const int crdep = cmd[CMD_OFFSET];
 
     dstcore = get_ep(epid, EP_COREID);
     dstep = get_ep(epid, EP_EPID);
@@ -245,52 +424,183 @@ int DTU::prepare_ackmsg(int epid) {
     return 0;
 }
 
-void DTU::handle_command(int core) {
+template<typename T>
+static bool dram_cmpxchg(char *dst, const char *src, size_t len, bool &res) {
+    if(len != sizeof(T) || (reinterpret_cast<uintptr_t>(dst) & (sizeof(T) - 1)))
+        return false;
+
+    T expected, desired;
+    memcpy(&expected, src, sizeof(T));
+    memcpy(&desired, src + sizeof(T), sizeof(T));
+    res = __atomic_compare_exchange_n(reinterpret_cast<T*>(dst), &expected, desired, false,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    if(!res) {
+        LOG(DTUERR, "(cmpxchg) failed; expected:");
+        dumpBytes(reinterpret_cast<uint8_t*>(const_cast<char*>(src)), sizeof(T));
+        LOG(DTUERR, "actual:");
+        dumpBytes(reinterpret_cast<uint8_t*>(&expected), sizeof(T));
+    }
+    return true;
+}
+
+static word_t atomic_op(int op, word_t *addr, word_t val) {
+    switch(op) {
+        case DTU::FETCH_ADD:
+            return __atomic_fetch_add(addr, val, __ATOMIC_SEQ_CST);
+        case DTU::SWAP:
+            return __atomic_exchange_n(addr, val, __ATOMIC_SEQ_CST);
+        case DTU::FETCH_OR:
+            return __atomic_fetch_or(addr, val, __ATOMIC_SEQ_CST);
+        default:
+            return __atomic_fetch_and(addr, val, __ATOMIC_SEQ_CST);
+    }
+}
+
+bool DTU::handle_dram_cmd(volatile word_t *cmd, int epid, int op, word_t &ctrl) {
+    if(_dram == nullptr || get_ep(epid, EP_COREID) != MEMORY_CORE)
+        return false;
+
+    // permissions and bounds have already been checked against the endpoint
+    word_t base = get_ep(epid, EP_LABEL) & ~MemGate::RWX;
+    word_t addr = base + cmd[CMD_OFFSET];
+    size_t length = cmd[CMD_LENGTH];
+    if(addr < _dram_base || addr + length > _dram_base + _dram_size)
+        return false;
+
+    char *mem = _dram + (addr - _dram_base);
+    char *buf = reinterpret_cast<char*>(cmd[CMD_ADDR]);
+    switch(op) {
+        case READ:
+            LOG(DTU, "(read) " << length << " bytes from DRAM #" << fmt(addr - _dram_base, "x")
+                << " -> " << fmt(buf, "p"));
+            scatter(cmd[CMD_ADDR], cmd_iovcnt(cmd), 0, mem, length);
+            break;
+
+        case WRITE:
+            LOG(DTU, "(write) " << length << " bytes to DRAM #" << fmt(addr - _dram_base, "x"));
+            gather(mem, cmd[CMD_ADDR], cmd_iovcnt(cmd), 0, length);
+            break;
+
+        case CMPXCHG: {
+            if(cmd[CMD_CTRL] & CTRL_IOVEC)
+                return false;
+            LOG(DTU, "(cmpxchg) " << length << " bytes @ DRAM #" << fmt(addr - _dram_base, "x"));
+            // we can only do that atomically for the sizes the CPU supports. the rest is done by
+            // the kernel's DTU as before
+            bool res;
+            if(!dram_cmpxchg<uint8_t>(mem, buf, length, res) &&
+               !dram_cmpxchg<uint16_t>(mem, buf, length, res) &&
+               !dram_cmpxchg<uint32_t>(mem, buf, length, res) &&
+               !dram_cmpxchg<uint64_t>(mem, buf, length, res))
+                return false;
+            if(!res)
+                ctrl |= CTRL_ERROR;
+            break;
+        }
+
+        default: {
+            // misaligned or vectored atomics are rejected by prepare_atomic
+            if((cmd[CMD_CTRL] & CTRL_IOVEC) || length != sizeof(word_t) ||
+                    (reinterpret_cast<uintptr_t>(mem) & (sizeof(word_t) - 1)))
+                return false;
+            LOG(DTU, "(atomic " << op << ") @ DRAM #" << fmt(addr - _dram_base, "x"));
+            word_t *val = reinterpret_cast<word_t*>(buf);
+            *val = atomic_op(op, reinterpret_cast<word_t*>(mem), *val);
+            break;
+        }
+    }
+
+    if(EXPECT_FALSE(_timing.enabled))
+        delay_transfer(MEMORY_CORE, length);
+
+    /* provide feedback to SW, like the response would do */
+    cmd[CMD_SIZE] = 0;
+    return true;
+}
+
+void DTU::handle_command(volatile word_t *cmd, word_t token, int core) {
+    cycles_t start = Profile::start();
     word_t newctrl = 0;
     int dstcoreid, dstepid;
 
     // clear error
-    set_cmd(CMD_CTRL, get_cmd(CMD_CTRL) & ~CTRL_ERROR);
+    cmd[CMD_CTRL] = cmd[CMD_CTRL] & ~CTRL_ERROR;
 
     // get regs
-    const int epid = get_cmd(CMD_EPID);
-    const int reply_epid = get_cmd(CMD_REPLY_EPID);
-    const word_t ctrl = get_cmd(CMD_CTRL);
-    int op = (ctrl >> 3) & 0x7;
+    const int epid = cmd[CMD_EPID];
+    const int reply_epid = cmd[CMD_REPLY_EPID];
+    const word_t ctrl = cmd[CMD_CTRL];
+    int op = (ctrl >> 3) & 0xF;
     if(epid >= EP_COUNT) {
         LOG(DTUERR, "DMA-error: invalid ep-id (" << epid << ")");
         newctrl |= CTRL_ERROR;
-        goto error;
+        goto done;
     }
 
     newctrl |= check_cmd(epid, op, get_ep(epid, EP_LABEL), get_ep(epid, EP_CREDITS),
-        get_cmd(CMD_OFFSET), get_cmd(CMD_LENGTH));
+        cmd[CMD_OFFSET], cmd[CMD_LENGTH]);
+
+    // the IOVecs have to provide space for (read) or the data of (write) the whole transfer
+    if((ctrl & CTRL_IOVEC) && (op == READ || op == WRITE) && cmd[CMD_LENGTH] > cmd_size(cmd)) {
+        LOG(DTUERR, "DMA-error: " << cmd[CMD_LENGTH] << " bytes do not fit into "
+            << cmd_size(cmd) << " bytes of IOVecs");
+        newctrl |= CTRL_ERROR;
+    }
+
+    switch(op) {
+        case READ:
+            _stats.reads++;
+            break;
+        case WRITE:
+            _stats.writes++;
+            break;
+        case CMPXCHG:
+            _stats.cmpxchgs++;
+            break;
+        case FETCH_ADD:
+        case SWAP:
+        case FETCH_OR:
+        case FETCH_AND:
+            _stats.atomics++;
+            break;
+    }
+
+    // memory accesses to DRAM don't need to involve the kernel
+    if(!(newctrl & CTRL_ERROR) && (op == READ || op == WRITE || op == CMPXCHG || is_atomic(op)) &&
+            handle_dram_cmd(cmd, epid, op, newctrl))
+        goto done;
+
     switch(op) {
         case REPLY:
-            newctrl |= prepare_reply(epid, dstcoreid, dstepid);
+            newctrl |= prepare_reply(cmd, epid, dstcoreid, dstepid);
             break;
         case SEND:
-            newctrl |= prepare_send(epid, dstcoreid, dstepid);
+            newctrl |= prepare_send(cmd, epid, dstcoreid, dstepid);
             break;
         case READ:
-            newctrl |= prepare_read(epid, dstcoreid, dstepid);
+            newctrl |= prepare_read(cmd, token, epid, dstcoreid, dstepid);
             break;
         case WRITE:
-            newctrl |= prepare_write(epid, dstcoreid, dstepid);
+            newctrl |= prepare_write(cmd, epid, dstcoreid, dstepid);
             break;
         case CMPXCHG:
-            newctrl |= prepare_cmpxchg(epid, dstcoreid, dstepid);
+            newctrl |= prepare_cmpxchg(cmd, token, epid, dstcoreid, dstepid);
+            break;
+        case FETCH_ADD:
+        case SWAP:
+        case FETCH_OR:
+        case FETCH_AND:
+            newctrl |= prepare_atomic(cmd, token, epid, dstcoreid, dstepid);
             break;
         case SENDCRD:
-            newctrl |= prepare_sendcrd(epid, dstcoreid, dstepid);
+            newctrl |= prepare_sendcrd(cmd, epid, dstcoreid, dstepid);
             break;
         case ACKMSG:
             newctrl |= prepare_ackmsg(epid);
-            set_cmd(CMD_CTRL, newctrl);
-            return;
+            goto done;
     }
     if(newctrl & CTRL_ERROR)
-        goto error;
+        goto done;
 
     // prepare message (add length and label)
     _buf.opcode = op;
@@ -299,24 +609,108 @@ void DTU::handle_command(int core) {
         _buf.core = core;
         _buf.snd_epid = epid;
         _buf.rpl_epid = reply_epid;
-        _buf.replylabel = get_cmd(CMD_REPLYLBL);
+        _buf.replylabel = cmd[CMD_REPLYLBL];
     }
     else
         _buf.has_replycap = 0;
 
-    send_msg(epid, dstcoreid, dstepid, op == REPLY);
+    if(op == WRITE)
+        send_write(cmd, epid, dstcoreid, dstepid);
+    else if(op == SEND && static_cast<int>(get_ep(epid, EP_COREID)) == MULTICAST_CORE)
+        send_multicast(epid);
+    else
+        send_msg(epid, dstcoreid, dstepid, op == REPLY);
+    // writes and messages don't get a response; they are done as soon as the data has been sent
+    if(op == WRITE || op == SEND || op == REPLY)
+        cmd[CMD_SIZE] = 0;
+
+done:
+    // reads, cmpxchgs and atomics via messages are finished when the response arrives
+    if((op == READ || op == CMPXCHG || is_atomic(op)) && !(newctrl & CTRL_ERROR) && cmd[CMD_SIZE] != 0)
+        cmd_start(token) = start;
+    else
+        finish_cmd(start);
+    cmd[CMD_CTRL] = newctrl;
+}
 
-error:
-    set_cmd(CMD_CTRL, newctrl);
+void DTU::finish_cmd(cycles_t start) {
+    cycles_t duration = Profile::stop() - start;
+    _stats.cmds++;
+    _stats.cmd_cycles += duration;
+    _stats.cmd_cycles_max = std::max(_stats.cmd_cycles_max, duration);
+}
+
+bool DTU::handle_queue(int core) {
+    bool worked = false;
+    // execute the queued commands in the order they have been issued
+    while(true) {
+        Command &next = _cmdq[_cmdq_issued % CMDQ_SIZE];
+        if(next.token != _cmdq_issued || !(next.regs[CMD_CTRL] & CTRL_START))
+            break;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        handle_command(next.regs, next.token, core);
+        _cmdq_issued++;
+        worked = true;
+    }
+    return worked;
 }
 
-void DTU::send_msg(int epid, int dstcoreid, int dstepid, bool isreply) {
+void DTU::send_msg(int epid, int dstcoreid, int dstepid, bool isreply,
+        const void *data, size_t len) {
+    _buf.length += len;
     LOG(DTU, (isreply ? ">> " : "-> ") << fmt(_buf.length, 3) << "b"
             << " lbl=" << fmt(_buf.label, "#0x", sizeof(label_t) * 2)
             << " over " << epid << " to c:ch=" << dstcoreid << ":" << dstepid
             << " (crd=#" << fmt((long)get_ep(dstepid, EP_CREDITS), "x") << ")");
 
-    _backend->send(dstcoreid, dstepid, &_buf);
+    _stats.eps[epid].msgs_sent++;
+    _stats.eps[epid].bytes_sent += _buf.length;
+    if(EXPECT_FALSE(_timing.enabled))
+        delay_transfer(dstcoreid, HEADER_SIZE + _buf.length);
+    if(data)
+        _backend->sendv(dstcoreid, dstepid, &_buf, data, len);
+    else
+        _backend->send(dstcoreid, dstepid, &_buf);
+}
+
+void DTU::send_multicast(int epid) {
+    const size_t members = std::min<size_t>(get_ep(epid, EP_EPID), GROUP_MAX_MEMBERS);
+    const size_t length = _buf.length;
+    // the message has been prepared once; only the label differs between the members
+    for(size_t i = 0; i < members; ++i) {
+        _buf.length = length;
+        _buf.label = get_group(epid, i, GRP_LABEL);
+        send_msg(epid, get_group(epid, i, GRP_COREID), get_group(epid, i, GRP_EPID), false);
+    }
+}
+
+void DTU::send_data(int epid, int dstcoreid, int dstepid, bool isreply, word_t src, size_t iovcnt,
+        size_t pos, size_t len) {
+    // contiguous data is passed to the backend directly; IOVecs are gathered into the message
+    if(iovcnt == 0)
+        send_msg(epid, dstcoreid, dstepid, isreply, reinterpret_cast<const char*>(src) + pos, len);
+    else {
+        gather(_buf.data + _buf.length, src, iovcnt, pos, len);
+        _buf.length += len;
+        send_msg(epid, dstcoreid, dstepid, isreply);
+    }
+}
+
+void DTU::send_write(volatile word_t *cmd, int epid, int dstcoreid, int dstepid) {
+    const size_t length = cmd[CMD_LENGTH];
+    const size_t chunk = _backend->chunk_size() - sizeof(word_t) * 2;
+
+    // send the data in chunks, so that the receiver can already copy while we're sending the rest
+    size_t pos = 0;
+    do {
+        size_t amount = std::min(chunk, length - pos);
+        _buf.length = sizeof(word_t) * 2;
+        reinterpret_cast<word_t*>(_buf.data)[0] = cmd[CMD_OFFSET] + pos;
+        reinterpret_cast<word_t*>(_buf.data)[1] = amount;
+        send_data(epid, dstcoreid, dstepid, false, cmd[CMD_ADDR], cmd_iovcnt(cmd), pos, amount);
+        pos += amount;
+    }
+    while(pos < length);
 }
 
 void DTU::handle_read_cmd(int epid) {
@@ -324,22 +718,34 @@ void DTU::handle_read_cmd(int epid) {
     word_t offset = base + reinterpret_cast<word_t*>(_buf.data)[0];
     word_t length = reinterpret_cast<word_t*>(_buf.data)[1];
     word_t dest = reinterpret_cast<word_t*>(_buf.data)[2];
+    word_t token = reinterpret_cast<word_t*>(_buf.data)[3];
+    word_t iovcnt = reinterpret_cast<word_t*>(_buf.data)[4];
     LOG(DTU, "(read) " << length << " bytes from #" << fmt(base, "x")
             << "+#" << fmt(offset - base, "x") << " -> " << fmt(dest, "p"));
     int dstcoreid = _buf.core;
     int dstepid = _buf.rpl_epid;
-    assert(length <= sizeof(_buf.data));
 
     _buf.opcode = RESP;
     _buf.credits = 0;
     _buf.label = 0;
-    _buf.length = sizeof(word_t) * 3;
-    reinterpret_cast<word_t*>(_buf.data)[0] = dest;
-    reinterpret_cast<word_t*>(_buf.data)[1] = length;
-    reinterpret_cast<word_t*>(_buf.data)[2] = 0;
-    memcpy(_buf.data + _buf.length, reinterpret_cast<void*>(offset), length);
-    _buf.length += length;
-    send_msg(epid, dstcoreid, dstepid, true);
+
+    // send the data in chunks; the requester is done when it received the last one
+    const size_t chunk = _backend->chunk_size() - sizeof(word_t) * 7;
+    size_t pos = 0;
+    do {
+        size_t amount = std::min<size_t>(chunk, length - pos);
+        _buf.length = sizeof(word_t) * 7;
+        reinterpret_cast<word_t*>(_buf.data)[0] = dest;
+        reinterpret_cast<word_t*>(_buf.data)[1] = amount;
+        reinterpret_cast<word_t*>(_buf.data)[2] = 0;
+        reinterpret_cast<word_t*>(_buf.data)[3] = token;
+        reinterpret_cast<word_t*>(_buf.data)[4] = iovcnt;
+        reinterpret_cast<word_t*>(_buf.data)[5] = pos;
+        reinterpret_cast<word_t*>(_buf.data)[6] = length;
+        send_msg(epid, dstcoreid, dstepid, true, reinterpret_cast<const char*>(offset) + pos, amount);
+        pos += amount;
+    }
+    while(pos < length);
 }
 
 void DTU::handle_write_cmd(int) {
@@ -357,19 +763,39 @@ void DTU::handle_resp_cmd() {
     word_t offset = base + reinterpret_cast<word_t*>(_buf.data)[0];
     word_t length = reinterpret_cast<word_t*>(_buf.data)[1];
     word_t resp = reinterpret_cast<word_t*>(_buf.data)[2];
+    word_t token = reinterpret_cast<word_t*>(_buf.data)[3];
+    word_t iovcnt = reinterpret_cast<word_t*>(_buf.data)[4];
+    word_t pos = reinterpret_cast<word_t*>(_buf.data)[5];
+    word_t total = reinterpret_cast<word_t*>(_buf.data)[6];
     LOG(DTU, "(resp) " << length << " bytes to #" << fmt(base, "x")
-            << "+#" << fmt(offset - base, "x") << " -> " << resp);
+            << "+#" << fmt(offset - base, "x") << " -> " << resp << " (token " << token << ")");
+
+    // find the command the response belongs to
+    volatile word_t *cmd = _cmdregs;
+    if(token != 0) {
+        Command &qcmd = _cmdq[token % CMDQ_SIZE];
+        if(qcmd.token != token) {
+            LOG(DTUERR, "DMA-error: dropping response for unknown command (token " << token << ")");
+            return;
+        }
+        cmd = qcmd.regs;
+    }
+
     assert(length <= sizeof(_buf.data));
-    memcpy(reinterpret_cast<void*>(offset), _buf.data + sizeof(word_t) * 3, length);
-    /* provide feedback to SW */
-    set_cmd(CMD_CTRL, get_cmd(CMD_CTRL) | resp);
-    set_cmd(CMD_SIZE, 0);
+    scatter(offset, iovcnt, pos, _buf.data + sizeof(word_t) * 7, length);
+    /* provide feedback to SW, as soon as all chunks have arrived */
+    if(pos + length == total) {
+        finish_cmd(cmd_start(token));
+        cmd[CMD_CTRL] = cmd[CMD_CTRL] | resp;
+        cmd[CMD_SIZE] = 0;
+    }
 }
 
 void DTU::handle_cmpxchg_cmd(int epid) {
     word_t base = _buf.label & ~MemGate::RWX;
     word_t offset = base + reinterpret_cast<word_t*>(_buf.data)[0];
     word_t length = reinterpret_cast<word_t*>(_buf.data)[1];
+    word_t token = reinterpret_cast<word_t*>(_buf.data)[3];
     LOG(DTU, "(cmpxchg) " << length << " bytes @ #" << fmt(base, "x")
             << "+#" << fmt(offset - base, "x"));
     int dstcoreid = _buf.core;
@@ -377,12 +803,12 @@ void DTU::handle_cmpxchg_cmd(int epid) {
 
     // do the compare exepge; no need to lock anything or so because our DTU is single-threaded
     word_t res;
-    if(memcmp(reinterpret_cast<void*>(offset), _buf.data + sizeof(word_t) * 3, length) == 0) {
-        memcpy(reinterpret_cast<void*>(offset), _buf.data + sizeof(word_t) * 3 + length, length);
+    if(memcmp(reinterpret_cast<void*>(offset), _buf.data + sizeof(word_t) * 4, length) == 0) {
+        memcpy(reinterpret_cast<void*>(offset), _buf.data + sizeof(word_t) * 4 + length, length);
         res = 0;
     }
     else {
-        uint8_t *expected = reinterpret_cast<uint8_t*>(_buf.data) + sizeof(word_t) * 3;
+        uint8_t *expected = reinterpret_cast<uint8_t*>(_buf.data) + sizeof(word_t) * 4;
         uint8_t *actual = reinterpret_cast<uint8_t*>(offset);
         LOG(DTUERR, "(cmpxchg) failed; expected:");
         dumpBytes(expected, length);
@@ -395,14 +821,47 @@ void DTU::handle_cmpxchg_cmd(int epid) {
     _buf.opcode = RESP;
     _buf.credits = 0;
     _buf.label = 0;
-    _buf.length = sizeof(word_t) * 3;
+    _buf.length = sizeof(word_t) * 7;
     reinterpret_cast<word_t*>(_buf.data)[0] = 0;
     reinterpret_cast<word_t*>(_buf.data)[1] = 0;
     reinterpret_cast<word_t*>(_buf.data)[2] = res;
+    reinterpret_cast<word_t*>(_buf.data)[3] = token;
+    reinterpret_cast<word_t*>(_buf.data)[4] = 0;
+    reinterpret_cast<word_t*>(_buf.data)[5] = 0;
+    reinterpret_cast<word_t*>(_buf.data)[6] = 0;
+    send_msg(epid, dstcoreid, dstepid, true);
+}
+
+void DTU::handle_atomic_cmd(int epid, int op) {
+    word_t base = _buf.label & ~MemGate::RWX;
+    word_t offset = base + reinterpret_cast<word_t*>(_buf.data)[0];
+    word_t dest = reinterpret_cast<word_t*>(_buf.data)[2];
+    word_t token = reinterpret_cast<word_t*>(_buf.data)[3];
+    word_t val = reinterpret_cast<word_t*>(_buf.data)[4];
+    LOG(DTU, "(atomic " << op << ") @ #" << fmt(base, "x") << "+#" << fmt(offset - base, "x"));
+    int dstcoreid = _buf.core;
+    int dstepid = _buf.rpl_epid;
+
+    // the memory might be shared with other processes, so we need real atomics here
+    word_t old = atomic_op(op, reinterpret_cast<word_t*>(offset), val);
+
+    // send the previous value back to the operand
+    _buf.opcode = RESP;
+    _buf.credits = 0;
+    _buf.label = 0;
+    _buf.length = sizeof(word_t) * 8;
+    reinterpret_cast<word_t*>(_buf.data)[0] = dest;
+    reinterpret_cast<word_t*>(_buf.data)[1] = sizeof(word_t);
+    reinterpret_cast<word_t*>(_buf.data)[2] = 0;
+    reinterpret_cast<word_t*>(_buf.data)[3] = token;
+    reinterpret_cast<word_t*>(_buf.data)[4] = 0;
+    reinterpret_cast<word_t*>(_buf.data)[5] = 0;
+    reinterpret_cast<word_t*>(_buf.data)[6] = sizeof(word_t);
+    reinterpret_cast<word_t*>(_buf.data)[7] = old;
     send_msg(epid, dstcoreid, dstepid, true);
 }
 
-void DTU::handle_receive(int i) {
+bool DTU::handle_receive(int i) {
     const size_t size = 1UL << get_ep(i, EP_BUF_ORDER);
     const size_t roffraw = get_ep(i, EP_BUF_ROFF);
     size_t woffraw = get_ep(i, EP_BUF_WOFF);
@@ -432,15 +891,18 @@ void DTU::handle_receive(int i) {
 
     ssize_t res = _backend->recv(i, &_buf);
     if(res == -1)
-        return;
+        return false;
     const int op = _buf.opcode;
+    _stats.eps[i].msgs_recv++;
+    _stats.eps[i].bytes_recv += res;
     const bool store = (~flags & FLAG_NO_RINGBUF) || op == SEND;
 
     if(store && (size_t)res > avail) {
         if((~flags & FLAG_NO_HEADER) || avail - HEADER_SIZE == 0) {
+            _stats.eps[i].drops++;
             LOG(DTUERR, "DMA-error: dropping message because space is not sufficient"
                     << " (required: " << res << ", available: " << avail << ")");
-            return;
+            return true;
         }
         LOG(DTUERR, "DMA-warning: cropping message from " << res << " to " << avail << " bytes");
         res = avail;
@@ -451,8 +913,9 @@ void DTU::handle_receive(int i) {
     const char *src = (flags & FLAG_NO_HEADER) ? _buf.data : (char*)&_buf;
 
     if(store && (~flags & FLAG_NO_HEADER) && msgsize > maxmsgsize) {
+        _stats.eps[i].drops++;
         LOG(DTUERR, "DMA-error: message too large (" << msgsize << " vs. " << maxmsgsize << ")");
-        return;
+        return true;
     }
 
     // put message into receive buffer
@@ -470,6 +933,12 @@ void DTU::handle_receive(int i) {
             case CMPXCHG:
                 handle_cmpxchg_cmd(i);
                 break;
+            case FETCH_ADD:
+            case SWAP:
+            case FETCH_OR:
+            case FETCH_AND:
+                handle_atomic_cmd(i, op);
+                break;
             case SEND:
                 memcpy(addr, src, msgsize);
                 break;
@@ -522,29 +991,80 @@ void DTU::handle_receive(int i) {
                 << fmt((long)get_ep(i, EP_CREDITS), "x")
                 << ")");
     }
+    return true;
+}
+
+void DTU::dump_stats() {
+    __log_lock();
+    Serial &ser = Serial::get();
+    ser << "DTU statistics:\n";
+    ser << "  commands: " << _stats.cmds << " (avg "
+        << (_stats.cmds ? _stats.cmd_cycles / _stats.cmds : 0) << " cycles, max "
+        << _stats.cmd_cycles_max << " cycles)\n";
+    ser << "  reads: " << _stats.reads << ", writes: " << _stats.writes
+        << ", cmpxchgs: " << _stats.cmpxchgs << ", atomics: " << _stats.atomics << "\n";
+    if(_timing.enabled)
+        ser << "  timing model: " << _stats.delay_ns << " ns injected\n";
+    for(int i = 0; i < EP_COUNT; ++i) {
+        const EpStats &ep = _stats.eps[i];
+        if(ep.msgs_sent == 0 && ep.msgs_recv == 0 && ep.credit_stalls == 0 && ep.drops == 0)
+            continue;
+        ser << "  EP" << i << ": sent " << ep.msgs_sent << " msgs (" << ep.bytes_sent << "b), "
+            << "received " << ep.msgs_recv << " msgs (" << ep.bytes_recv << "b), "
+            << "credit stalls: " << ep.credit_stalls << ", drops: " << ep.drops << "\n";
+    }
+    __log_unlock();
 }
 
 void *DTU::thread(void *arg) {
     DTU *dma = static_cast<DTU*>(arg);
     int core = coreid();
 
+    // the endpoints that received a message in the last iteration
+    word_t pending = 0;
+
     // don't allow any interrupts here
     HWInterrupts::Guard noints;
     while(dma->_run) {
-        // should we send something?
-        if(dma->get_cmd(CMD_CTRL) & CTRL_START)
-            dma->handle_command(core);
+        bool worked = false;
+
+        // should we send something? the queued commands have been issued before the command in
+        // the registers, so that we look at the registers first and execute the queue before it
+        bool start = dma->get_cmd(CMD_CTRL) & CTRL_START;
+        worked |= dma->handle_queue(core);
+        if(start) {
+            dma->handle_command(dma->_cmdregs, 0, core);
+            worked = true;
+        }
 
-        // have we received a message?
-        for(int i = 0; i < EP_COUNT; ++i)
-            dma->handle_receive(i);
+        // have we received a message? only look at the endpoints that might have one
+        word_t eps = pending | dma->_backend->fetch_pending();
+        pending = 0;
+        while(eps) {
+            int i = __builtin_ctzl(eps);
+            eps &= eps - 1;
+            // there might be more messages for this endpoint
+            if(dma->handle_receive(i)) {
+                pending |= static_cast<word_t>(1) << i;
+                worked = true;
+            }
+        }
+
+        if(dma->_dump_stats) {
+            dma->_dump_stats = false;
+            dma->dump_stats();
+        }
 
-        dma->wait();
+        if(worked)
+            dma->wakeup_sw();
+        else
+            dma->_backend->wait();
     }
 
     if(Config::get().is_kernel())
         dma->_backend->destroy();
     delete dma->_backend;
+    dma->_backend = nullptr;
     return 0;
 }
 
@@ -15,15 +15,24 @@
  */
 
 #include <m3/arch/host/DTUBackend.h>
+#include <m3/util/Math.h>
 #include <m3/DTU.h>
 #include <m3/Log.h>
 
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/msg.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
+#include <sys/uio.h>
+#include <linux/futex.h>
+#include <atomic>
+#include <climits>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 
 namespace m3 {
@@ -52,6 +61,12 @@ void MsgBackend::reset() {
 }
 
 void MsgBackend::send(int core, int ep, const DTU::Buffer *buf) {
+    if(buf->length + DTU::HEADER_SIZE - sizeof(buf->length) > MAX_MSG_SIZE) {
+        LOG(DTUERR, "Sending message to EP " << core << ":" << ep << " failed: "
+            << buf->length << " bytes exceed the message queue limit");
+        return;
+    }
+
     int msgqid = msgget(get_msgkey(core, ep), 0);
     // send it
     int res;
@@ -76,9 +91,14 @@ ssize_t MsgBackend::recv(int ep, DTU::Buffer *buf) {
     return res;
 }
 
-SocketBackend::SocketBackend() : _sock(socket(AF_UNIX, SOCK_DGRAM, 0)), _localsocks(), _endpoints() {
+SocketBackend::SocketBackend()
+        : _sock(socket(AF_UNIX, SOCK_DGRAM, 0)), _localsocks(), _endpoints(),
+          _epoll(epoll_create1(EPOLL_CLOEXEC)), _cmdfd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+          _sleeping(false), _ready(), _collected() {
     if(_sock == -1)
         PANIC("Unable to open socket: " << strerror(errno));
+    if(_epoll == -1 || _cmdfd == -1)
+        PANIC("Unable to create epoll instance or eventfd: " << strerror(errno));
 
     // build socket names for all endpoints on all cores
     for(int core = 0; core < MAX_CORES; ++core) {
@@ -107,7 +127,19 @@ SocketBackend::SocketBackend() : _sock(socket(AF_UNIX, SOCK_DGRAM, 0)), _localso
         sockaddr_un *ep = _endpoints + coreid() * EP_COUNT + epid;
         if(bind(_localsocks[epid], (struct sockaddr*)ep, sizeof(*ep)) == -1)
             PANIC("Binding socket for ep " << epid << " failed: " << strerror(errno));
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = epid;
+        if(epoll_ctl(_epoll, EPOLL_CTL_ADD, _localsocks[epid], &ev) == -1)
+            PANIC("Adding socket for ep " << epid << " to epoll failed: " << strerror(errno));
     }
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = EP_COUNT;
+    if(epoll_ctl(_epoll, EPOLL_CTL_ADD, _cmdfd, &ev) == -1)
+        PANIC("Adding eventfd to epoll failed: " << strerror(errno));
 }
 
 void SocketBackend::send(int core, int ep, const DTU::Buffer *buf) {
@@ -116,6 +148,23 @@ void SocketBackend::send(int core, int ep, const DTU::Buffer *buf) {
         LOG(DTUERR, "Sending message to EP " << core << ":" << ep << " failed: " << strerror(errno));
 }
 
+void SocketBackend::sendv(int core, int ep, DTU::Buffer *buf, const void *data, size_t len) {
+    iovec iov[2];
+    iov[0].iov_base = buf;
+    iov[0].iov_len = buf->length - len + DTU::HEADER_SIZE;
+    iov[1].iov_base = const_cast<void*>(data);
+    iov[1].iov_len = len;
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = _endpoints + core * EP_COUNT + ep;
+    msg.msg_namelen = sizeof(sockaddr_un);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = ARRAY_SIZE(iov);
+    if(sendmsg(_sock, &msg, 0) == -1)
+        LOG(DTUERR, "Sending message to EP " << core << ":" << ep << " failed: " << strerror(errno));
+}
+
 ssize_t SocketBackend::recv(int ep, DTU::Buffer *buf) {
     ssize_t res = recvfrom(_localsocks[ep], buf, sizeof(*buf), 0, nullptr, nullptr);
     if(res <= 0)
@@ -123,4 +172,360 @@ ssize_t SocketBackend::recv(int ep, DTU::Buffer *buf) {
     return res;
 }
 
+void SocketBackend::collect(int timeout) {
+    epoll_event evs[EP_COUNT + 1];
+    int res = epoll_wait(_epoll, evs, ARRAY_SIZE(evs), timeout);
+    for(int i = 0; i < res; ++i) {
+        if(evs[i].data.u32 == EP_COUNT) {
+            uint64_t val;
+            ssize_t UNUSED count = read(_cmdfd, &val, sizeof(val));
+        }
+        else
+            _ready |= static_cast<word_t>(1) << evs[i].data.u32;
+    }
+    _collected = true;
+}
+
+word_t SocketBackend::fetch_pending() {
+    // if we didn't sleep in between, ask epoll which sockets are readable. that's a single system
+    // call instead of one recvfrom per endpoint
+    if(!_collected)
+        collect(0);
+    word_t eps = _ready;
+    _ready = 0;
+    _collected = false;
+    return eps;
+}
+
+void SocketBackend::wait() {
+    // announce that we're going to sleep before we check for commands. thus, either we see the
+    // command or notify() sees that we're sleeping and signals the eventfd.
+    _sleeping.store(true);
+    if(!DTU::get().has_work())
+        collect(-1);
+    _sleeping.store(false);
+}
+
+void SocketBackend::notify() {
+    // the command register has to be written before we check whether the DTU thread sleeps
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(_sleeping.load()) {
+        uint64_t val = 1;
+        ssize_t UNUSED count = write(_cmdfd, &val, sizeof(val));
+    }
+}
+
+/**
+ * Each record in a ring starts with this header, followed by the message. Records are always
+ * aligned to 8 bytes, so that the header itself never wraps around.
+ */
+struct ShmRecord {
+    std::atomic<uint32_t> committed;
+    uint32_t size;
+};
+
+struct ShmBackend::Ring {
+    // the largest record. messages are small and memory transfers are split into chunks that fit
+    static constexpr size_t MAX_RECORD  = 16 * 1024;
+    // leave room for a few records, so that the sender can continue while the receiver copies
+    static constexpr size_t SIZE        = MAX_RECORD * 4;
+
+    // all positions are increased monotonically and are only taken modulo SIZE for the access
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    // futex word that is increased whenever the receiver has freed space
+    alignas(64) std::atomic<uint32_t> freed;
+    std::atomic<uint32_t> waiters;
+    alignas(64) char data[SIZE];
+
+    ShmRecord *record(uint64_t pos) {
+        return reinterpret_cast<ShmRecord*>(data + pos % SIZE);
+    }
+
+    void write(uint64_t pos, const void *src, size_t len) {
+        size_t off = pos % SIZE;
+        size_t first = Math::min(len, SIZE - off);
+        memcpy(data + off, src, first);
+        memcpy(data, static_cast<const char*>(src) + first, len - first);
+    }
+    void read(uint64_t pos, void *dst, size_t len) const {
+        size_t off = pos % SIZE;
+        size_t first = Math::min(len, SIZE - off);
+        memcpy(dst, data + off, first);
+        memcpy(static_cast<char*>(dst) + first, data, len - first);
+    }
+    void clear(uint64_t pos, size_t len) {
+        size_t off = pos % SIZE;
+        size_t first = Math::min(len, SIZE - off);
+        memset(data + off, 0, first);
+        memset(data, 0, len - first);
+    }
+};
+
+struct alignas(64) ShmBackend::Doorbell {
+    // futex word that is increased whenever there is something to do for the DTU thread
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> sleeping;
+    // the endpoints that received a message since the DTU thread looked last time
+    std::atomic<word_t> pending;
+};
+
+// give up sending after waiting that many times in a row for a receiver that does not free space
+static const int SHM_MAX_FULL_WAITS     = 100;
+
+static void futex_wait(std::atomic<uint32_t> *addr, uint32_t val, const timespec *timeout) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, val, timeout, nullptr, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+ShmBackend::ShmBackend() : _shm(), _lastseq() {
+    // the kernel creates the shared memory in create()
+    if(Config::get().is_kernel())
+        return;
+
+    map(SharedMemory::JOIN);
+
+    // drop messages that have been left over by the previous user of our core
+    for(int ep = 0; ep < EP_COUNT; ++ep) {
+        Ring *r = ring(coreid(), ep);
+        uint64_t head = r->head.load();
+        ShmRecord *rec;
+        while((rec = r->record(head))->committed.load() != 0) {
+            size_t len = Math::round_up(sizeof(ShmRecord) + rec->size, DTU_PKG_SIZE);
+            r->clear(head, len);
+            head += len;
+        }
+        r->head.store(head);
+    }
+    _lastseq = doorbell(coreid())->seq.load();
+}
+
+ShmBackend::~ShmBackend() {
+    // note that this unlinks the shared memory in the kernel
+    delete _shm;
+}
+
+void ShmBackend::map(SharedMemory::Op op) {
+    // the doorbells of all cores, followed by the rings of all endpoints of all cores
+    size_t size = sizeof(Doorbell) * MAX_CORES + sizeof(Ring) * MAX_CORES * EP_COUNT;
+    _shm = new SharedMemory("dtu", size, op);
+}
+
+ShmBackend::Ring *ShmBackend::ring(int core, int ep) const {
+    Doorbell *rings = static_cast<Doorbell*>(_shm->addr()) + MAX_CORES;
+    return reinterpret_cast<Ring*>(rings) + core * EP_COUNT + ep;
+}
+
+ShmBackend::Doorbell *ShmBackend::doorbell(int core) const {
+    return static_cast<Doorbell*>(_shm->addr()) + core;
+}
+
+void ShmBackend::create() {
+    // ftruncate fills it with zeros, which is the initial state of all rings and doorbells
+    map(SharedMemory::CREATE);
+}
+
+void ShmBackend::destroy() {
+}
+
+size_t ShmBackend::chunk_size() const {
+    return (Ring::MAX_RECORD - sizeof(ShmRecord) - DTU::HEADER_SIZE) & ~(DTU_PKG_SIZE - 1);
+}
+
+void ShmBackend::send(int core, int ep, const DTU::Buffer *buf) {
+    sendv(core, ep, const_cast<DTU::Buffer*>(buf), nullptr, 0);
+}
+
+void ShmBackend::sendv(int core, int ep, DTU::Buffer *buf, const void *data, size_t datalen) {
+    Ring *r = ring(core, ep);
+    const size_t size = buf->length + DTU::HEADER_SIZE;
+    const size_t len = Math::round_up(sizeof(ShmRecord) + size, DTU_PKG_SIZE);
+    if(len > Ring::MAX_RECORD) {
+        LOG(DTUERR, "Sending message to EP " << core << ":" << ep << " failed: " << size
+            << "b exceed the maximum of " << (Ring::MAX_RECORD - sizeof(ShmRecord)) << "b");
+        return;
+    }
+
+    // reserve space for the record
+    uint64_t pos, lasthead = 0;
+    int fullwaits = 0;
+    while(true) {
+        uint32_t freed = r->freed.load();
+        uint64_t head = r->head.load();
+        pos = r->tail.load();
+        if(pos + len - head <= Ring::SIZE) {
+            if(r->tail.compare_exchange_strong(pos, pos + len))
+                break;
+            continue;
+        }
+
+        // the receiver seems to be gone, if it does not free anything for a while
+        if(head != lasthead) {
+            lasthead = head;
+            fullwaits = 0;
+        }
+        else if(++fullwaits > SHM_MAX_FULL_WAITS) {
+            LOG(DTUERR, "Sending message to EP " << core << ":" << ep << " failed: ring is full");
+            return;
+        }
+
+        timespec timeout = {0, 10 * 1000 * 1000};
+        r->waiters.fetch_add(1);
+        futex_wait(&r->freed, freed, &timeout);
+        r->waiters.fetch_sub(1);
+    }
+
+    // write the message and commit it afterwards
+    r->write(pos + sizeof(ShmRecord), buf, size - datalen);
+    if(datalen)
+        r->write(pos + sizeof(ShmRecord) + size - datalen, data, datalen);
+    ShmRecord *rec = r->record(pos);
+    rec->size = size;
+    rec->committed.store(1, std::memory_order_release);
+
+    doorbell(core)->pending.fetch_or(static_cast<word_t>(1) << ep);
+    ring_doorbell(core);
+}
+
+ssize_t ShmBackend::recv(int ep, DTU::Buffer *buf) {
+    Ring *r = ring(coreid(), ep);
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    ShmRecord *rec = r->record(head);
+    if(rec->committed.load(std::memory_order_acquire) == 0)
+        return -1;
+
+    size_t size = rec->size;
+    size_t len = Math::round_up(sizeof(ShmRecord) + size, DTU_PKG_SIZE);
+    r->read(head + sizeof(ShmRecord), buf, size);
+    // clear it, so that the next record we find at a position has to be committed explicitly
+    r->clear(head, len);
+    r->head.store(head + len, std::memory_order_release);
+
+    r->freed.fetch_add(1);
+    if(r->waiters.load() > 0)
+        futex_wake(&r->freed, INT_MAX);
+    return size;
+}
+
+word_t ShmBackend::fetch_pending() {
+    return doorbell(coreid())->pending.exchange(0);
+}
+
+void ShmBackend::ring_doorbell(int core) {
+    Doorbell *bell = doorbell(core);
+    bell->seq.fetch_add(1);
+    if(bell->sleeping.load() != 0)
+        futex_wake(&bell->seq, 1);
+}
+
+void ShmBackend::notify() {
+    ring_doorbell(coreid());
+}
+
+void ShmBackend::wait() {
+    Doorbell *bell = doorbell(coreid());
+    // everything that has been sent since we took _lastseq changes seq, so that we don't sleep
+    bell->sleeping.store(1);
+    futex_wait(&bell->seq, _lastseq, nullptr);
+    bell->sleeping.store(0);
+    _lastseq = bell->seq.load();
+}
+
+RecordBackend::RecordBackend(DTU::Backend *backend, const char *dir)
+        : _backend(backend), _fd(), _sent() {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/core%d-%d.rec", dir, coreid(), getpid());
+    _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(_fd == -1)
+        PANIC("Unable to open " << path << " for recording: " << strerror(errno));
+
+    // the syscall EP has already been configured at this point
+    DTU &dtu = DTU::get();
+    Recording::FileHeader hd;
+    hd.magic = Recording::MAGIC;
+    hd.core = coreid();
+    hd.sysc_label = dtu.get_ep(DTU::SYSC_EP, DTU::EP_LABEL);
+    hd.sysc_epid = dtu.get_ep(DTU::SYSC_EP, DTU::EP_EPID);
+    hd.sysc_credits = dtu.get_ep(DTU::SYSC_EP, DTU::EP_CREDITS);
+    if(write(_fd, &hd, sizeof(hd)) != sizeof(hd))
+        PANIC("Writing header to " << path << " failed: " << strerror(errno));
+}
+
+RecordBackend::~RecordBackend() {
+    close(_fd);
+    delete _backend;
+}
+
+ssize_t RecordBackend::recv(int ep, DTU::Buffer *buf) {
+    ssize_t res = _backend->recv(ep, buf);
+    if(res == -1)
+        return res;
+
+    Recording::Record rec;
+    rec.time = _sent;
+    rec.ep = ep;
+    rec.size = res;
+    iovec iov[2];
+    iov[0].iov_base = &rec;
+    iov[0].iov_len = sizeof(rec);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = res;
+    if(writev(_fd, iov, 2) != static_cast<ssize_t>(sizeof(rec) + res))
+        LOG(DTUERR, "Recording message for EP " << ep << " failed: " << strerror(errno));
+    return res;
+}
+
+void ReplayBackend::read_header(const char *file, Recording::FileHeader *hd) {
+    int fd = open(file, O_RDONLY);
+    if(fd == -1)
+        PANIC("Unable to open recording " << file << ": " << strerror(errno));
+    ssize_t res = read(fd, hd, sizeof(*hd));
+    close(fd);
+    if(res != sizeof(*hd) || hd->magic != Recording::MAGIC)
+        PANIC("Invalid recording " << file);
+}
+
+ReplayBackend::ReplayBackend(const char *file)
+        : _fd(open(file, O_RDONLY | O_CLOEXEC)), _sent(), _valid(), _next() {
+    Recording::FileHeader hd;
+    if(_fd == -1 || read(_fd, &hd, sizeof(hd)) != sizeof(hd))
+        PANIC("Unable to read recording " << file << ": " << strerror(errno));
+    _valid = next();
+}
+
+ReplayBackend::~ReplayBackend() {
+    close(_fd);
+}
+
+bool ReplayBackend::next() {
+    ssize_t res = read(_fd, &_next, sizeof(_next));
+    if(res == 0) {
+        LOG(DTU, "Replay finished after " << _sent << " sent messages");
+        return false;
+    }
+    if(res != sizeof(_next) || _next.size > sizeof(DTU::Buffer))
+        PANIC("Recording is corrupt");
+    return true;
+}
+
+word_t ReplayBackend::fetch_pending() {
+    if(!_valid || _next.time > _sent)
+        return 0;
+    return static_cast<word_t>(1) << _next.ep;
+}
+
+ssize_t ReplayBackend::recv(int ep, DTU::Buffer *buf) {
+    if(!_valid || _next.time > _sent || static_cast<int>(_next.ep) != ep)
+        return -1;
+
+    ssize_t size = _next.size;
+    if(read(_fd, buf, size) != size)
+        PANIC("Recording is corrupt");
+    _valid = next();
+    return size;
+}
+
 }
@@ -23,44 +23,43 @@
 #include <m3/ELF.h>
 
 #include <sys/fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
 namespace m3 {
 
-static void write_file(pid_t pid, const char *suffix, const void *data, size_t size) {
-    if(data) {
-        char path[64];
-        snprintf(path, sizeof(path), "/tmp/m3/%d-%s", pid, suffix);
-        int fd = open(path, O_WRONLY | O_TRUNC | O_CREAT, 0600);
-        if(fd < 0)
-            perror("open");
-        else {
-            write(fd, data, size);
-            close(fd);
-        }
+// the pipe to receive our state from the parent, if we have been forked
+static int state_fd = -1;
+
+static void read_all(int fd, void *data, size_t size) {
+    char *buf = static_cast<char*>(data);
+    while(size > 0) {
+        ssize_t res = read(fd, buf, size);
+        if(res <= 0)
+            PANIC("Reading VPE state failed: " << strerror(errno));
+        buf += res;
+        size -= res;
     }
 }
 
-static void *read_from(const char *suffix, void *dst, size_t &size) {
-    char path[64];
-    snprintf(path, sizeof(path), "/tmp/m3/%d-%s", getpid(), suffix);
-    int fd = open(path, O_RDONLY);
-    if(fd >= 0) {
-        if(dst == nullptr) {
-            struct stat st;
-            if(fstat(fd, &st) == -1)
-                return nullptr;
-            size = st.st_size;
-            dst = Heap::alloc(size);
-        }
-
-        read(fd, dst, size);
-        unlink(path);
-        close(fd);
-    }
-    return dst;
+static bool write_state(int fd, const Config::Params &params, const void *caps, size_t capslen,
+                        const void *eps, size_t epslen, const void *mounts, size_t mountlen) {
+    // the first byte notifies the child that it can start; the state and the parameters follow.
+    // the state comes first, because VPE::self is constructed before the Config
+    char byte = 1;
+    struct iovec iov[] = {
+        {&byte, sizeof(byte)},
+        {const_cast<void*>(caps), capslen},
+        {const_cast<void*>(eps), epslen},
+        {&mountlen, sizeof(mountlen)},
+        {const_cast<void*>(mounts), mountlen},
+        {const_cast<Config::Params*>(&params), sizeof(params)},
+    };
+    size_t total = sizeof(byte) + sizeof(params) + capslen + epslen + sizeof(mountlen) + mountlen;
+    return writev(fd, iov, ARRAY_SIZE(iov)) == static_cast<ssize_t>(total);
 }
 
 void VPE::init_state() {
@@ -69,14 +68,29 @@ void VPE::init_state() {
     Heap::free(_mounts);
 
     _caps = new BitField<CAP_TOTAL>();
-    size_t len = sizeof(*_caps);
-    read_from("caps", _caps, len);
-
     _eps = new BitField<EP_COUNT>();
-    len = sizeof(*_eps);
-    read_from("eps", _eps, len);
+    _mounts = nullptr;
+    _mountlen = 0;
+
+    // if we have been started via exec, the pipe has been inherited. the Config reads the
+    // parameters behind our state and closes it afterwards
+    int fd = state_fd;
+    if(fd == -1) {
+        const char *env = getenv("M3_STATE_FD");
+        if(env)
+            fd = atoi(env);
+    }
 
-    _mounts = read_from("mounts", nullptr, _mountlen);
+    if(fd != -1) {
+        read_all(fd, _caps, sizeof(*_caps));
+        read_all(fd, _eps, sizeof(*_eps));
+        read_all(fd, &_mountlen, sizeof(_mountlen));
+        if(_mountlen > 0) {
+            _mounts = Heap::alloc(_mountlen);
+            read_all(fd, _mounts, _mountlen);
+        }
+        state_fd = -1;
+    }
 }
 
 Errors::Code VPE::run(void *lambda) {
@@ -96,11 +110,13 @@ Errors::Code VPE::run(void *lambda) {
         close(fd[1]);
 
         // wait until parent notifies us
-        read(fd[0], &byte, 1);
-        close(fd[0]);
+        if(read(fd[0], &byte, 1) != 1)
+            _exit(1);
 
-        Config::get().reset();
+        // our state and the parameters follow in the pipe
+        state_fd = fd[0];
         VPE::self().init_state();
+        Config::get().reset(fd[0]);
 
         std::function<int()> *func = reinterpret_cast<std::function<int()>*>(lambda);
         (*func)();
@@ -110,39 +126,56 @@ Errors::Code VPE::run(void *lambda) {
         // parent
         close(fd[0]);
 
-        // let the kernel create the config-file etc. for the given pid
-        Syscalls::get().vpectrl(sel(), Syscalls::VCTRL_START, pid, nullptr);
-
-        write_file(pid, "caps", _caps, sizeof(*_caps));
-        write_file(pid, "eps", _eps, sizeof(*_eps));
-        write_file(pid, "mounts", _mounts, _mountlen);
+        // let the kernel start the VPE for the given pid and get the child's parameters
+        Config::Params params;
+        Errors::Code err = Syscalls::get().vpestart(sel(), pid, params);
 
-        // notify child; it can start now
-        write(fd[1], &byte, 1);
+        // notify child and pass the parameters and our state to it. if that failed, the child
+        // notices the closed pipe and exits
+        if(err == Errors::NO_ERROR && !write_state(fd[1], params, _caps, sizeof(*_caps),
+                                                   _eps, sizeof(*_eps), _mounts, _mountlen))
+            LOG(DEF, "Unable to pass state to VPE: " << strerror(errno));
         close(fd[1]);
+        if(err != Errors::NO_ERROR)
+            return err;
     }
     return Errors::NO_ERROR;
 }
 
 Errors::Code VPE::exec(int argc, const char **argv) {
-    static char buffer[1024];
-    char templ[] = "/tmp/m3-XXXXXX";
+    char path[64];
     int tmp, pid, fd[2];
-    ssize_t res;
+    FileInfo info;
+    char *bin;
+    ssize_t res = 0;
     char byte = 1;
     if(pipe(fd) == -1)
         return Errors::OUT_OF_MEM;
 
     FileRef exec(argv[0], FILE_R);
-    if(Errors::occurred())
+    if(Errors::occurred() || exec->stat(info) != Errors::NO_ERROR)
         goto errorTemp;
-    tmp = mkstemp(templ);
+    // keep the executable in memory instead of a temp file
+    tmp = memfd_create("m3-exec", 0);
     if(tmp < 0)
         goto errorTemp;
+    if(ftruncate(tmp, info.size) == -1)
+        goto errorExec;
+    bin = static_cast<char*>(mmap(nullptr, info.size, PROT_READ | PROT_WRITE, MAP_SHARED, tmp, 0));
+    if(bin == MAP_FAILED)
+        goto errorExec;
 
-    // copy executable from M3-fs to a temp file
-    while((res = exec->read(buffer, sizeof(buffer))) > 0)
-        write(tmp, buffer, res);
+    // copy executable from M3-fs into it, with as few reads as possible
+    for(size_t pos = 0; pos < info.size; pos += res) {
+        res = exec->read(bin + pos, info.size - pos);
+        if(res <= 0)
+            break;
+    }
+    // the mapping would make the file busy for exec
+    munmap(bin, info.size);
+    // don't execute a truncated binary
+    if(res <= 0)
+        goto errorRead;
 
     pid = fork();
     if(pid == -1)
@@ -152,8 +185,8 @@ Errors::Code VPE::exec(int argc, const char **argv) {
         close(fd[1]);
 
         // wait until parent notifies us
-        read(fd[0], &byte, 1);
-        close(fd[0]);
+        if(read(fd[0], &byte, 1) != 1)
+            _exit(1);
 
         // copy args to null-terminate them
         char **args = new char*[argc + 1];
@@ -161,15 +194,16 @@ Errors::Code VPE::exec(int argc, const char **argv) {
             args[i] = (char*)argv[i];
         args[argc] = nullptr;
 
-        // open it readonly again as fexecve requires
-        int tmpdup = open(templ, O_RDONLY);
-        // we don't need it anymore afterwards
-        unlink(templ);
-        // it needs to be executable
-        fchmod(tmpdup, 0700);
-        // close writable fd to make it non-busy
+        // open it readonly again as fexecve requires and close writable fd to make it non-busy
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", tmp);
+        int tmpdup = open(path, O_RDONLY | O_CLOEXEC);
         close(tmp);
 
+        // the new program receives its state via the pipe
+        char fdstr[16];
+        snprintf(fdstr, sizeof(fdstr), "%d", fd[0]);
+        setenv("M3_STATE_FD", fdstr, 1);
+
         // execute that file
         fexecve(tmpdup, args, environ);
         PANIC("Exec of '" << argv[0] << "' failed: " << strerror(errno));
@@ -179,19 +213,28 @@ Errors::Code VPE::exec(int argc, const char **argv) {
         close(fd[0]);
         close(tmp);
 
-        // let the kernel create the config-file etc. for the given pid
-        Syscalls::get().vpectrl(sel(), Syscalls::VCTRL_START, pid, nullptr);
+        // let the kernel start the VPE for the given pid and get the child's parameters
+        Config::Params params;
+        Errors::Code err = Syscalls::get().vpestart(sel(), pid, params);
 
-        write_file(pid, "caps", _caps, sizeof(*_caps));
-        write_file(pid, "eps", _eps, sizeof(*_eps));
-        write_file(pid, "mounts", _mounts, _mountlen);
-
-        // notify child; it can start now
-        write(fd[1], &byte, 1);
+        // notify child and pass the parameters and our state to it. if that failed, the child
+        // notices the closed pipe and exits
+        if(err == Errors::NO_ERROR && !write_state(fd[1], params, _caps, sizeof(*_caps),
+                                                   _eps, sizeof(*_eps), _mounts, _mountlen))
+            LOG(DEF, "Unable to pass state to VPE: " << strerror(errno));
         close(fd[1]);
+        if(err != Errors::NO_ERROR)
+            return err;
     }
     return Errors::NO_ERROR;
 
+errorRead:
+    close(tmp);
+    close(fd[0]);
+    close(fd[1]);
+    // the file ended before its size says so, if no error occurred
+    return Errors::occurred() ? Errors::last : Errors::INVALID_ELF;
+
 errorExec:
     close(tmp);
 errorTemp:
@@ -51,6 +51,66 @@ void MemGate::read_sync(void *data, size_t len, size_t offset) {
     DTU::get().wait_for_mem_cmd();
 }
 
+void MemGate::writev(const IOVec *iov, size_t count, size_t offset) {
+#if defined(__host__)
+    EVENT_TRACER_write_sync();
+    wait_until_sent();
+    ensure_activated();
+    DTU::get().writev(epid(), iov, count, offset, IOVec::total(iov, count));
+    wait_until_sent();
+#else
+    for(size_t i = 0; i < count; ++i) {
+        write_sync(iov[i].base, iov[i].len, offset);
+        offset += iov[i].len;
+    }
+#endif
+}
+
+void MemGate::readv(const IOVec *iov, size_t count, size_t offset) {
+#if defined(__host__)
+    EVENT_TRACER_read_sync();
+    wait_until_sent();
+    ensure_activated();
+    DTU::get().readv(epid(), iov, count, offset, IOVec::total(iov, count));
+    wait_until_sent();
+    DTU::get().wait_for_mem_cmd();
+#else
+    for(size_t i = 0; i < count; ++i) {
+        read_sync(iov[i].base, iov[i].len, offset);
+        offset += iov[i].len;
+    }
+#endif
+}
+
+word_t MemGate::read_async(void *data, size_t len, size_t offset) {
+#if defined(__host__)
+    ensure_activated();
+    return DTU::get().read_async(epid(), data, len, offset);
+#else
+    read_sync(data, len, offset);
+    return 0;
+#endif
+}
+
+word_t MemGate::write_async(const void *data, size_t len, size_t offset) {
+#if defined(__host__)
+    ensure_activated();
+    return DTU::get().write_async(epid(), data, len, offset);
+#else
+    write_sync(data, len, offset);
+    return 0;
+#endif
+}
+
+bool MemGate::wait(word_t token) {
+#if defined(__host__)
+    return DTU::get().wait_for_cmd(token);
+#else
+    (void)token;
+    return true;
+#endif
+}
+
 #if defined(__host__)
 bool MemGate::cmpxchg_sync(void *data, size_t len, size_t offset) {
     EVENT_TRACER_cmpxchg_sync();
@@ -58,6 +118,17 @@ bool MemGate::cmpxchg_sync(void *data, size_t len, size_t offset) {
     wait_until_sent();
     return DTU::get().wait_for_mem_cmd();
 }
+
+word_t MemGate::atomic_op(int op, word_t val, size_t offset) {
+    // the DTU replaces the operand with the previous value
+    word_t data = val;
+    wait_until_sent();
+    ensure_activated();
+    DTU::get().atomic(epid(), op, &data, offset);
+    wait_until_sent();
+    DTU::get().wait_for_mem_cmd();
+    return data;
+}
 #endif
 
 }
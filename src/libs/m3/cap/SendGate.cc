@@ -17,6 +17,7 @@
 #include <m3/cap/SendGate.h>
 #include <m3/cap/VPE.h>
 #include <m3/Syscalls.h>
+#include <cstring>
 #include <assert.h>
 
 namespace m3 {
@@ -42,4 +43,33 @@ SendGate SendGate::create_for(const VPE &vpe, size_t dstep, label_t label, word_
     return gate;
 }
 
+SendGate SendGate::create_multicast(const capsel_t *members, size_t count, RecvGate *rcvgate,
+        capsel_t sel) {
+    uint flags = 0;
+    if(sel == INVALID)
+        sel = VPE::self().alloc_cap();
+    else
+        flags |= KEEP_SEL;
+    SendGate gate(sel, flags, rcvgate);
+    Syscalls::get().createmcast(gate.sel(), members, count);
+    return gate;
+}
+
+void SendGate::sendv(const IOVec *iov, size_t count) {
+#if defined(__host__)
+    wait_until_sent();
+    ensure_activated();
+    DTU::get().sendv(epid(), iov, count, _rcvgate->label(), _rcvgate->epid());
+    wait_until_sent();
+#else
+    // the other DTUs need the message in one piece
+    size_t len = IOVec::total(iov, count);
+    char *buf = new char[len];
+    for(size_t i = 0, off = 0; i < count; off += iov[i].len, ++i)
+        memcpy(buf + off, iov[i].base, iov[i].len);
+    send_sync(buf, len);
+    delete[] buf;
+#endif
+}
+
 }
@@ -88,7 +88,7 @@ Tracing::Tracing() {
 
 #if !defined(__t2__)
     for(int i = 0; i < ARRAY_SIZE(trace_core); ++i)
-        trace_core[i] = !!((1 << i) & PE_MASK);
+        trace_core[i] = !!((1ULL << i) & PE_MASK);
 #endif
 
     if(coreid() != KERNEL_CORE)